@@ -0,0 +1,256 @@
+// Micro-benchmarks of the terrain and physics hot paths: no window, no OpenGL context.
+// Sweeps the terrain resolution N and the number of bumps, and measures for each pair:
+//   evaluate_terrain_height, get_normal_from_position, update_positions, create_terrain_mesh and full ball shots.
+// Each result gives the time per operation (median and minimum of the repetitions), the throughput and the heap allocations per operation.
+// The results are printed, and written as JSON to compare runs.
+//
+// Usage: benchmark [--output file.json] [--seed n] [--threads n] [--quick]
+
+#include "simulation.hpp"
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+using namespace cgp;
+
+// Every heap allocation of the process goes through these operators, so they count them
+// (gcc does not see that operator delete is replaced too, and warns about the free of a pointer from operator new)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+static std::atomic<long> allocation_count(0);
+static std::atomic<long> allocation_bytes(0);
+
+void* operator new(std::size_t size)
+{
+	allocation_count.fetch_add(1, std::memory_order_relaxed);
+	allocation_bytes.fetch_add(long(size), std::memory_order_relaxed);
+	if (void* p = std::malloc(size == 0 ? 1 : size))
+		return p;
+	throw std::bad_alloc();
+}
+void* operator new[](std::size_t size) { return operator new(size); }
+void* operator new(std::size_t size, std::nothrow_t const&) noexcept
+{
+	try { return operator new(size); }
+	catch (std::bad_alloc const&) { return nullptr; }
+}
+void* operator new[](std::size_t size, std::nothrow_t const&) noexcept { return operator new(size, std::nothrow); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+
+// Keeps the results of the measured code alive
+static volatile float sink = 0;
+
+struct benchmark_result
+{
+	std::string name;
+	int N = 0;
+	int n_bumps = 0;
+	long operations = 0;			// operations measured (all repetitions)
+	double ns_per_op = 0;			// median of the repetitions
+	double ns_per_op_min = 0;
+	double throughput = 0;			// items per second (median)
+	std::string throughput_unit;
+	double allocations_per_op = 0;
+	double bytes_per_op = 0;
+};
+
+struct benchmark_settings
+{
+	double min_repetition_time = 0.05;	// seconds of one repetition (the calls are repeated until it is reached)
+	int repetitions = 5;
+};
+
+/** Measure f, which performs ops_per_call operations and returns the number of items it processed (for the throughput).
+f is called once to warm up, then in repetitions of at least min_repetition_time.	*/
+template <typename F>
+benchmark_result measure(benchmark_settings const& settings, std::string const& name, int N, int n_bumps, int ops_per_call, std::string const& unit, F f)
+{
+	using clock = std::chrono::steady_clock;
+
+	// warm up, and number of calls per repetition
+	auto t0 = clock::now();
+	f();
+	double const call_time = std::max(std::chrono::duration<double>(clock::now() - t0).count(), 1e-9);
+	long const calls = std::max(1L, long(settings.min_repetition_time / call_time));
+
+	std::vector<double> ns_per_op, throughput;
+	long const count0 = allocation_count.load(), bytes0 = allocation_bytes.load();
+	for (int r = 0; r < settings.repetitions; r++)
+	{
+		double items = 0;
+		t0 = clock::now();
+		for (long c = 0; c < calls; c++)
+			items += f();
+		double const seconds = std::chrono::duration<double>(clock::now() - t0).count();
+
+		ns_per_op.push_back(seconds * 1e9 / (calls * ops_per_call));
+		throughput.push_back(items / seconds);
+	}
+	long const count = allocation_count.load() - count0, bytes = allocation_bytes.load() - bytes0;
+
+	std::sort(ns_per_op.begin(), ns_per_op.end());
+	std::sort(throughput.begin(), throughput.end());
+
+	benchmark_result result;
+	result.name = name;
+	result.N = N;
+	result.n_bumps = n_bumps;
+	result.operations = calls * ops_per_call * settings.repetitions;
+	result.ns_per_op = ns_per_op[ns_per_op.size() / 2];
+	result.ns_per_op_min = ns_per_op.front();
+	result.throughput = throughput[throughput.size() / 2];
+	result.throughput_unit = unit;
+	result.allocations_per_op = double(count) / result.operations;
+	result.bytes_per_op = double(bytes) / result.operations;
+
+	std::printf("%-26s N=%-5d bumps=%-4d %14.1f ns/op (min %14.1f) %11.4g %-14s %9.2f allocs/op %9.0f B/op\n",
+		name.c_str(), N, n_bumps, result.ns_per_op, result.ns_per_op_min, result.throughput, unit.c_str(), result.allocations_per_op, result.bytes_per_op);
+	std::fflush(stdout);
+	return result;
+}
+
+int main(int argc, char* argv[])
+{
+	std::string output = "benchmark.json";
+	uint64_t seed = 1;
+	int n_threads = 0;
+	bool quick = false;
+	for (int i = 1; i < argc; i++)
+	{
+		if (std::strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+			output = argv[++i];
+		else if (std::strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+			seed = std::strtoull(argv[++i], nullptr, 10);
+		else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+			n_threads = std::atoi(argv[++i]);
+		else if (std::strcmp(argv[i], "--quick") == 0)
+			quick = true;
+		else
+		{
+			std::cerr << "Usage: " << argv[0] << " [--output file.json] [--seed n] [--threads n] [--quick]" << std::endl;
+			return 1;
+		}
+	}
+
+	benchmark_settings settings;
+	std::vector<int> const N_values = quick ? std::vector<int>{100, 250} : std::vector<int>{100, 250, 500, 1000};
+	std::vector<int> const n_bumps_values = quick ? std::vector<int>{20, 60} : std::vector<int>{20, 60, 200};
+	if (quick)
+		settings.min_repetition_time = 0.01;
+
+	float const terrain_length = 100;
+	int const n_points = 4096;			// query points of the per-point benchmarks
+	int const n_shots = 16;				// shots per call of the shot benchmark
+
+	// same streams as the game: the same seed gives the same terrains, query points and shots
+	random_stream const world_random(seed);
+	random_stream point_random = world_random.split(random_placement);
+	std::vector<float> px(n_points), py(n_points);
+	for (int k = 0; k < n_points; k++)
+	{
+		px[k] = point_random.uniform(-terrain_length / 2, terrain_length / 2);
+		py[k] = point_random.uniform(-terrain_length / 2, terrain_length / 2);
+	}
+
+	std::printf("Seed %llu, %d terrain threads\n\n", (unsigned long long)seed, parallel_thread_count(n_threads));
+	std::vector<benchmark_result> results;
+
+	for (int n_bumps : n_bumps_values)
+	{
+		for (int N : N_values)
+		{
+			Terrain terrain;
+			terrain.n_threads = n_threads;
+			terrain.random = world_random.split(random_terrain).split(0);
+
+			results.push_back(measure(settings, "create_terrain_mesh", N, n_bumps, 1, "vertices/s", [&]() {
+				terrain.create_terrain_mesh(N, terrain_length, n_bumps);
+				return double(N) * N;
+			}));
+
+			results.push_back(measure(settings, "update_positions", N, n_bumps, 1, "vertices/s", [&]() {
+				terrain.update_positions();
+				return double(N) * N;
+			}));
+
+			results.push_back(measure(settings, "evaluate_terrain_height", N, n_bumps, n_points, "evaluations/s", [&]() {
+				float sum = 0;
+				for (int k = 0; k < n_points; k++)
+					sum += terrain.evaluate_terrain_height(px[k], py[k]);
+				sink = sink + sum;
+				return double(n_points);
+			}));
+
+			results.push_back(measure(settings, "get_normal_from_position", N, n_bumps, n_points, "evaluations/s", [&]() {
+				float sum = 0;
+				for (int k = 0; k < n_points; k++)
+					sum += terrain.get_normal_from_position(N, terrain_length, px[k], py[k]).z;
+				sink = sink + sum;
+				return double(n_points);
+			}));
+
+			// full shots with the step of the game (the same shots at every call), the throughput counts the physics steps
+			ball_simulation simulation;
+			float const dt = simulation.parameters.simulation_speed / 60.0f;
+			int const max_steps = 60 * 60;
+			float const boundary = terrain_length * 0.4f;
+			results.push_back(measure(settings, "ball_shot", N, n_bumps, n_shots, "steps/s", [&]() {
+				random_stream shot_random = world_random.split(random_placement).split(1);
+				long n_steps = 0;
+				for (int k = 0; k < n_shots; k++)
+				{
+					vec3 ball = {shot_random.uniform(-boundary, boundary), shot_random.uniform(-boundary, boundary), 0};
+					vec3 target = {shot_random.uniform(-boundary, boundary), shot_random.uniform(-boundary, boundary), 0};
+					ball.z = terrain.get_height(ball.x, ball.y) + simulation.parameters.ball_radius;
+					target.z = terrain.get_height(target.x, target.y) + simulation.parameters.target_radius;
+					simulation.target_position = target;
+					simulation.reset(ball, false);
+
+					float phi = shot_random.uniform(0, 2 * Pi);
+					float theta = shot_random.uniform(Pi / 6, Pi / 3);
+					vec3 direction = {std::cos(theta) * std::cos(phi), std::cos(theta) * std::sin(phi), std::sin(theta)};
+					n_steps += simulation.simulate_shot(terrain, direction, shot_random.uniform(0.3f, 1.7f), dt, max_steps).n_steps;
+				}
+				return double(n_steps);
+			}));
+		}
+	}
+
+	// JSON report
+	std::ofstream file(output);
+	if (!file)
+	{
+		std::cerr << "Error: cannot write " << output << std::endl;
+		return 1;
+	}
+	file << "{\n";
+	file << "  \"seed\": " << seed << ",\n";
+	file << "  \"terrain_threads\": " << parallel_thread_count(n_threads) << ",\n";
+	file << "  \"repetitions\": " << settings.repetitions << ",\n";
+	file << "  \"results\": [\n";
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		benchmark_result const& r = results[i];
+		file << "    {\"name\": \"" << r.name << "\", \"N\": " << r.N << ", \"n_bumps\": " << r.n_bumps
+			<< ", \"operations\": " << r.operations << ", \"ns_per_op\": " << r.ns_per_op << ", \"ns_per_op_min\": " << r.ns_per_op_min
+			<< ", \"throughput\": " << r.throughput << ", \"throughput_unit\": \"" << r.throughput_unit << "\""
+			<< ", \"allocations_per_op\": " << r.allocations_per_op << ", \"bytes_per_op\": " << r.bytes_per_op << "}"
+			<< (i + 1 < results.size() ? "," : "") << "\n";
+	}
+	file << "  ]\n}\n";
+	std::cout << "\nResults written to " << output << std::endl;
+
+	return 0;
+}
@@ -0,0 +1,228 @@
+// Headless run of the ball physics: no window, no OpenGL context.
+// Generates a level, then kicks the ball from random positions in random directions and reports the hit rate and the speed.
+//
+// Usage: headless [n_shots] [n_bumps] [N] [seed]
+//
+// headless --check [seed] instead checks the accuracy of the fast terrain evaluations against their references,
+// and exits with a non-zero status if one of them is beyond its documented bound.
+
+#include "simulation.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+using namespace cgp;
+
+// Indexed sum of the bumps against the brute-force sum (see Terrain::bump_cutoff):
+// the difference is at most exp(-bump_cutoff^2) * sum(h_i) over the bumps ignored at the point, plus the float rounding of both sums
+static bool check_bump_index(Terrain const& terrain, random_stream random)
+{
+	float const half = terrain.terrain_length / 2;
+	double const cutoff2 = double(terrain.bump_cutoff) * terrain.bump_cutoff;
+	double const epsilon = std::ldexp(1.0, -24);
+
+	double max_error = 0, max_ratio = 0;
+	bool ok = true;
+	for (int k = 0; k < 20000; k++)
+	{
+		float const x = random.uniform(-half, half), y = random.uniform(-half, half);
+
+		double ignored = 0, z = 0;
+		for (int i = 0; i < terrain.n_bumps; i++)
+		{
+			double const dx = x - terrain.p_i[i].x, dy = y - terrain.p_i[i].y;
+			double const t = (dx * dx + dy * dy) / (double(terrain.s_i[i]) * terrain.s_i[i]);
+			z += terrain.h_i[i] * std::exp(-t);
+			if (t > cutoff2)
+				ignored += terrain.h_i[i];
+		}
+
+		double const truncation = ignored * std::exp(-cutoff2);
+		double const rounding = 2 * (terrain.n_bumps + 1) * epsilon * z;
+		double const error = std::abs(double(terrain.evaluate_bumps_height(x, y)) - terrain.evaluate_bumps_height_brute_force(x, y));
+
+		max_error = std::max(max_error, error);
+		if (truncation > 0)
+			max_ratio = std::max(max_ratio, error / (truncation + rounding));
+		ok = ok && error <= truncation + rounding;
+	}
+
+	std::cout << "  bump index: max error " << max_error << ", at most " << max_ratio << " of the bound " << (ok ? "ok" : "FAILED") << std::endl;
+	return ok;
+}
+
+// Batched rows of every instruction set against evaluate_terrain_height (documented bound: relative error 1e-5)
+static bool check_batch_rows(Terrain const& terrain, random_stream random)
+{
+	float const half = terrain.terrain_length / 2;
+	double const bound = 1e-5;
+	terrain_batch_isa const isas[] = {batch_avx2, batch_sse2, batch_scalar};
+	char const* const names[] = {"avx2", "sse2", "scalar"};
+
+	bool ok = true;
+	for (int n = 0; n < 3; n++)
+	{
+		if (!Terrain::batch_isa_supported(isas[n]))
+		{
+			std::cout << "  batch rows (" << names[n] << "): not supported, skipped" << std::endl;
+			continue;
+		}
+
+		random_stream rows = random.split(n);
+		double max_error = 0;
+		std::vector<float> x, y, z;
+		for (int row = 0; row < 400; row++)
+		{
+			// scattered points of every length (SIMD body and scalar tail), then full rows of the mesh
+			int const count = row < 200 ? 1 + row % 67 : 150;
+			float const y_row = rows.uniform(-half, half);
+			x.resize(count);
+			y.resize(count);
+			z.resize(count);
+			for (int k = 0; k < count; k++)
+			{
+				x[k] = row < 200 ? rows.uniform(-half, half) : -half + terrain.terrain_length * k / (count - 1);
+				y[k] = row < 200 ? rows.uniform(-half, half) : y_row;
+			}
+
+			terrain.evaluate_terrain_height_row(x.data(), y.data(), z.data(), count, isas[n]);
+			for (int k = 0; k < count; k++)
+			{
+				double const reference = terrain.evaluate_terrain_height(x[k], y[k]);
+				max_error = std::max(max_error, std::abs(z[k] - reference) / std::abs(reference));
+			}
+		}
+
+		bool const row_ok = max_error <= bound;
+		std::cout << "  batch rows (" << names[n] << "): max relative error " << max_error << " (bound " << bound << ") " << (row_ok ? "ok" : "FAILED") << std::endl;
+		ok = ok && row_ok;
+	}
+	return ok;
+}
+
+// Scattered points (batched simulation) against evaluate_terrain_sample: same bound on the heights, gradients relative to 1 + |gradient|
+static bool check_batch_points(Terrain const& terrain, random_stream random)
+{
+	float const half = terrain.terrain_length / 2;
+	double const bound = 1e-5;
+	int const count = 20000;
+
+	std::vector<float> x(count), y(count), z(count), sample_z(count), dz_dx(count), dz_dy(count);
+	for (int k = 0; k < count; k++)
+	{
+		x[k] = random.uniform(-half, half);
+		y[k] = random.uniform(-half, half);
+	}
+	terrain.evaluate_terrain_height_points(x.data(), y.data(), z.data(), count);
+	terrain.evaluate_terrain_sample_points(x.data(), y.data(), sample_z.data(), dz_dx.data(), dz_dy.data(), count);
+
+	double max_height_error = 0, max_gradient_error = 0;
+	for (int k = 0; k < count; k++)
+	{
+		terrain_sample const reference = terrain.evaluate_terrain_sample(x[k], y[k]);
+		double const height_error = std::max(std::abs(z[k] - reference.height), std::abs(sample_z[k] - reference.height)) / std::abs(reference.height);
+		max_height_error = std::max(max_height_error, height_error);
+		max_gradient_error = std::max(max_gradient_error, double(norm(vec2(dz_dx[k], dz_dy[k]) - reference.gradient) / (1 + norm(reference.gradient))));
+	}
+
+	bool const ok = max_height_error <= bound && max_gradient_error <= bound;
+	std::cout << "  batch points: max relative error " << max_height_error << " (heights), " << max_gradient_error << " (gradients), bound " << bound << " " << (ok ? "ok" : "FAILED") << std::endl;
+	return ok;
+}
+
+static int run_checks(uint64_t seed)
+{
+	random_stream const world_random(seed);
+	bool ok = true;
+
+	// sparse and dense bumps
+	for (int n_bumps : {20, 100, 1000})
+	{
+		Terrain terrain;
+		terrain.build_mesh = false;
+		terrain.random = world_random.split(random_terrain).split(n_bumps);
+		terrain.create_terrain_mesh(2, 100, n_bumps);
+		std::cout << n_bumps << " bumps (seed " << seed << ")" << std::endl;
+
+		random_stream const points = world_random.split(random_placement).split(n_bumps);
+		ok = check_bump_index(terrain, points.split(0)) && ok;
+		ok = check_batch_rows(terrain, points.split(1)) && ok;
+		ok = check_batch_points(terrain, points.split(2)) && ok;
+
+		// the cutoff also applies without the index, so the scalar and the batched queries still agree
+		terrain.bump_grid_resolution = 0;
+		std::cout << "  without the bump index:" << std::endl;
+		ok = check_batch_points(terrain, points.split(3)) && ok;
+	}
+
+	std::cout << (ok ? "All checks passed" : "Some checks FAILED") << std::endl;
+	return ok ? 0 : 1;
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc > 1 && std::strcmp(argv[1], "--check") == 0)
+		return run_checks(argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 1);
+
+	int const n_shots = argc > 1 ? std::atoi(argv[1]) : 10000;
+	int const n_bumps = argc > 2 ? std::atoi(argv[2]) : 100;
+	int const N = argc > 3 ? std::atoi(argv[3]) : 500;
+	uint64_t const seed = argc > 4 ? std::strtoull(argv[4], nullptr, 10) : uint64_t(std::chrono::system_clock::now().time_since_epoch().count());
+	float const terrain_length = 100;
+
+	// same streams as the game: the same seed gives the same terrain
+	random_stream const world_random(seed);
+	random_stream shot_random = world_random.split(random_placement);
+
+	// only the bumps and the height cache are needed by the physics
+	Terrain terrain;
+	terrain.build_mesh = false;
+	terrain.random = world_random.split(random_terrain).split(0);
+	terrain.create_terrain_mesh(N, terrain_length, n_bumps);
+
+	ball_simulation simulation;
+	float const dt = simulation.parameters.simulation_speed / 60.0f;	// same step as the game
+	int const max_steps = 60 * 60;										// one minute of game time
+	float const boundary = terrain_length * 0.4f;
+
+	auto random_position = [&](float height_above_ground) {
+		vec3 p = {shot_random.uniform(-boundary, boundary), shot_random.uniform(-boundary, boundary), 0};
+		p.z = terrain.get_height(p.x, p.y) + height_above_ground;
+		return p;
+	};
+
+	int n_hits = 0;
+	long n_steps = 0;
+	float closest_sum = 0;
+
+	auto const t0 = std::chrono::steady_clock::now();
+	for (int k = 0; k < n_shots; k++)
+	{
+		simulation.target_position = random_position(simulation.parameters.target_radius);
+		simulation.reset(random_position(simulation.parameters.ball_radius), false);
+
+		// same ranges as the kick chosen in the game
+		float phi = shot_random.uniform(0, 2 * Pi);
+		float theta = shot_random.uniform(Pi / 6, Pi / 3);
+		vec3 direction = {std::cos(theta) * std::cos(phi), std::cos(theta) * std::sin(phi), std::sin(theta)};
+
+		shot_result result = simulation.simulate_shot(terrain, direction, shot_random.uniform(0.3f, 1.7f), dt, max_steps);
+		n_hits += result.target_hit;
+		n_steps += result.n_steps;
+		closest_sum += result.closest_target_distance;
+	}
+	double const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+	std::cout << n_shots << " shots on " << N << "x" << N << " terrain with " << n_bumps << " bumps (seed " << seed << ")" << std::endl;
+	std::cout << "  hits: " << n_hits << " (" << 100.0 * n_hits / n_shots << "%)" << std::endl;
+	std::cout << "  mean closest distance to the target: " << closest_sum / n_shots << std::endl;
+	std::cout << "  mean steps per shot: " << double(n_steps) / n_shots << std::endl;
+	std::cout << "  " << seconds << " s (" << n_shots / seconds << " shots/s, " << n_steps / seconds << " steps/s)" << std::endl;
+
+	return 0;
+}
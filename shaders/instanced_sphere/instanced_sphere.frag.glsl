@@ -0,0 +1,56 @@
+#version 330 core
+
+// Fragment shader of instanced_spheres_drawable: Phong illumination by the environment light (as the default mesh shader)
+
+// Inputs coming from the vertex shader
+in struct fragment_data
+{
+    vec3 position;
+    vec3 normal;
+    vec3 color;
+} fragment;
+
+// Output of the fragment shader - output color
+layout(location=0) out vec4 FragColor;
+
+// Per-frame data shared by the shaders (uniform buffer filled by environment_structure::update_frame_uniform_buffer)
+layout(std140, row_major) uniform frame_data
+{
+	mat4 view;
+	mat4 projection;
+	vec4 camera_position;
+	float ambiant;
+	float diffuse;
+	float specular;
+	float specular_exp;
+	float dl_max;
+	float arena_length;
+	int cluster_resolution;
+	int data_width;
+};
+
+uniform vec3 light;		// position of the light
+
+// Coefficients of phong illumination model (common to all the spheres)
+uniform float phong_ambient;
+uniform float phong_diffuse;
+uniform float phong_specular;
+uniform float phong_specular_exponent;
+
+void main()
+{
+	vec3 N = normalize(fragment.normal);
+	vec3 L = normalize(light - fragment.position);
+
+	float diffuse_component = max(dot(N, L), 0.0);
+	float specular_component = 0.0;
+	if (diffuse_component > 0.0)
+	{
+		vec3 R = reflect(-L, N);
+		vec3 V = normalize(camera_position.xyz - fragment.position);
+		specular_component = pow(max(dot(R, V), 0.0), phong_specular_exponent);
+	}
+
+	vec3 color_shading = (phong_ambient + phong_diffuse * diffuse_component) * fragment.color + phong_specular * specular_component * vec3(1.0, 1.0, 1.0);
+	FragColor = vec4(color_shading, 1.0);
+}
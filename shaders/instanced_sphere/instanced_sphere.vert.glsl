@@ -0,0 +1,45 @@
+#version 330 core
+
+// Vertex shader of instanced_spheres_drawable: one instance per sphere, all sharing the same unit sphere
+
+// Inputs coming from VBOs
+layout (location = 0) in vec3 vertex_position;	// vertex of the unit sphere
+layout (location = 1) in vec3 vertex_normal;
+layout (location = 4) in vec4 instance_center;	// center (xyz) and radius (w) of the sphere
+layout (location = 5) in vec3 instance_color;
+
+// Output variables sent to the fragment shader
+out struct fragment_data
+{
+    vec3 position;
+    vec3 normal;
+    vec3 color;
+} fragment;
+
+// Per-frame data shared by the shaders (uniform buffer filled by environment_structure::update_frame_uniform_buffer)
+layout(std140, row_major) uniform frame_data
+{
+	mat4 view;
+	mat4 projection;
+	vec4 camera_position;
+	float ambiant;
+	float diffuse;
+	float specular;
+	float specular_exp;
+	float dl_max;
+	float arena_length;
+	int cluster_resolution;
+	int data_width;
+};
+
+void main()
+{
+	// uniform scaling and translation: the normal is unchanged
+	vec3 position = instance_center.xyz + instance_center.w * vertex_position;
+
+	fragment.position = position;
+	fragment.normal = vertex_normal;
+	fragment.color = instance_color;
+
+	gl_Position = projection * view * vec4(position, 1.0);
+}
@@ -1,42 +1,56 @@
-#version 330 core
-
-// Inputs coming from VBOs
-layout (location = 0) in vec3 vertex_position;
-layout (location = 1) in vec3 vertex_normal;
-layout (location = 2) in vec3 vertex_color;
-layout (location = 3) in vec2 vertex_uv;
-
-// Output variables sent to the fragment shader
-out struct fragment_data
-{
-    vec3 position;
-    vec3 normal;
-    vec3 color;
-    vec2 uv;
-} fragment;
-
-// Uniform variables expected to receive from the C++ program
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-
-void main()
-{
-	// The position of the vertex in the world space
-	vec4 position = model * vec4(vertex_position, 1.0);
-
-	// The normal of the vertex in the world space
-	mat4 modelNormal = transpose(inverse(model));
-	vec4 normal = modelNormal * vec4(vertex_normal, 0.0);
-
-	// The projected position of the vertex in the normalized device coordinates:
-	vec4 position_projected = projection * view * position;
-
-	// Fill the parameters sent to the fragment shader
-	fragment.position = position.xyz;
-	fragment.normal   = normal.xyz;
-	fragment.color = vertex_color;
-	fragment.uv = vertex_uv;
-
-	gl_Position = position_projected; // gl_Position is the projected vertex position (in normalized device coordinates)
-}
+#version 330 core
+
+// Inputs coming from VBOs
+layout (location = 0) in vec3 vertex_position;
+layout (location = 1) in vec3 vertex_normal;
+layout (location = 2) in vec3 vertex_color;
+layout (location = 3) in vec2 vertex_uv;
+
+// Output variables sent to the fragment shader
+out struct fragment_data
+{
+    vec3 position;
+    vec3 normal;
+    vec3 color;
+    vec2 uv;
+} fragment;
+
+// Uniform variables expected to receive from the C++ program
+uniform mat4 model;
+
+// Per-frame data shared by the shaders (uniform buffer filled by environment_structure::update_frame_uniform_buffer)
+layout(std140, row_major) uniform frame_data
+{
+	mat4 view;
+	mat4 projection;
+	vec4 camera_position;
+	float ambiant;
+	float diffuse;
+	float specular;
+	float specular_exp;
+	float dl_max;				// maximum distance from which a light should be visible
+	float arena_length;			// the light clusters cover [-arena_length/2, arena_length/2]^2
+	int cluster_resolution;		// number of clusters along one coordinate
+	int data_width;				// number of texels per row of the light textures
+};
+
+void main()
+{
+	// The position of the vertex in the world space
+	vec4 position = model * vec4(vertex_position, 1.0);
+
+	// The normal of the vertex in the world space
+	mat4 modelNormal = transpose(inverse(model));
+	vec4 normal = modelNormal * vec4(vertex_normal, 0.0);
+
+	// The projected position of the vertex in the normalized device coordinates:
+	vec4 position_projected = projection * view * position;
+
+	// Fill the parameters sent to the fragment shader
+	fragment.position = position.xyz;
+	fragment.normal   = normal.xyz;
+	fragment.color = vertex_color;
+	fragment.uv = vertex_uv;
+
+	gl_Position = position_projected; // gl_Position is the projected vertex position (in normalized device coordinates)
+}
@@ -0,0 +1,55 @@
+#version 330 core
+
+// Vertex shader used with transform feedback to generate the terrain vertices on the GPU.
+// No vertex attribute: vertex gl_VertexID is the sample (ku, kv) of the N*N grid, with gl_VertexID = kv + N*ku (same as the CPU mesh).
+// The position and the normal are written in the VBOs of the terrain mesh.
+
+uniform int N;						// number of samples along one coordinate
+uniform float terrain_length;		// the terrain covers [-terrain_length/2, terrain_length/2]^2
+uniform int n_bumps;
+uniform samplerBuffer bumps;		// one texel per bump: (x, y, h, 1/s^2)
+uniform float bump_cutoff2;			// a bump is ignored where d^2/s^2 > bump_cutoff2 (same as Terrain::bump_cutoff)
+
+out vec3 tf_position;
+out vec3 tf_normal;
+
+void main()
+{
+	int ku = gl_VertexID / N;
+	int kv = gl_VertexID - N * ku;
+
+	vec2 p = (vec2(ku, kv) / float(N - 1) - 0.5) * terrain_length;
+
+	// bumps: h exp(-d^2/s^2), and their gradient
+	float z = 0.0;
+	vec2 gradient = vec2(0.0);
+	for (int i = 0; i < n_bumps; i++)
+	{
+		vec4 b = texelFetch(bumps, i);
+		vec2 d = p - b.xy;
+		float t = dot(d, d) * b.w;
+		if (t > bump_cutoff2)
+			continue;
+		float c = b.z * exp(-t);
+		z += c;
+		gradient -= 2.0 * d * b.w * c;
+	}
+
+	// walls: 1 / (m + 0.01) with m the distance to the closest side (same as Terrain::evaluate_terrain_sample)
+	vec2 uv = p / terrain_length + 0.5;
+	float m = min(min(uv.x, uv.y), min(1.0 - uv.x, 1.0 - uv.y));
+	float wall = 1.0 / (m + 0.01);
+	float dwall_dm = -wall * wall / terrain_length;
+
+	if (m == uv.x)
+		gradient.x += dwall_dm;
+	else if (m == 1.0 - uv.x)
+		gradient.x -= dwall_dm;
+	else if (m == uv.y)
+		gradient.y += dwall_dm;
+	else
+		gradient.y -= dwall_dm;
+
+	tf_position = vec3(p, z + wall);
+	tf_normal = normalize(vec3(-gradient, 1.0));
+}
@@ -0,0 +1,117 @@
+#include "asset_loader.hpp"
+
+#include <algorithm>
+
+void asset_loader::add(std::string const& name, std::function<void()> load, std::function<void()> upload)
+{
+	asset a;
+	a.timing.name = name;
+	a.load = std::move(load);
+	a.upload = std::move(upload);
+	assets.push_back(std::move(a));
+}
+
+double asset_loader::since_start(clock::time_point t) const
+{
+	return std::chrono::duration<double, std::milli>(t - start_time).count();
+}
+
+void asset_loader::start()
+{
+	start_time = clock::now();
+	next_load = 0;
+	n_uploaded = 0;
+	timings.clear();
+
+#ifndef __EMSCRIPTEN__
+	int const hardware = std::max(1, int(std::thread::hardware_concurrency()));
+	int const n = n_threads > 0 ? n_threads : std::min(int(assets.size()), hardware);
+	for (int k = 0; k < n; k++)
+		workers.emplace_back(&asset_loader::worker, this);
+#endif
+}
+
+void asset_loader::worker()
+{
+	while (true)
+	{
+		int i;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (next_load == int(assets.size()))
+				return;
+			i = next_load++;
+		}
+
+		asset& a = assets[i];
+		clock::time_point const t0 = clock::now();
+		a.timing.wait = since_start(t0);
+		a.load();
+		a.timing.load = std::chrono::duration<double, std::milli>(clock::now() - t0).count();
+
+		std::lock_guard<std::mutex> lock(mutex);
+		loaded.push_back(i);
+	}
+}
+
+int asset_loader::process_uploads(double budget_ms)
+{
+	clock::time_point const t0 = clock::now();
+
+	while (!finished())
+	{
+		int i = -1;
+#ifndef __EMSCRIPTEN__
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!loaded.empty())
+			{
+				i = loaded.front();
+				loaded.pop_front();
+			}
+		}
+		if (i == -1)
+			break;
+#else
+		// no worker: load on this thread
+		i = next_load++;
+		clock::time_point const t_load = clock::now();
+		assets[i].timing.wait = since_start(t_load);
+		assets[i].load();
+		assets[i].timing.load = std::chrono::duration<double, std::milli>(clock::now() - t_load).count();
+#endif
+
+		asset& a = assets[i];
+		clock::time_point const t_upload = clock::now();
+		a.upload();
+		clock::time_point const t_end = clock::now();
+		a.timing.upload = std::chrono::duration<double, std::milli>(t_end - t_upload).count();
+		a.timing.ready = since_start(t_end);
+		timings.push_back(a.timing);
+		n_uploaded++;
+
+		if (std::chrono::duration<double, std::milli>(t_end - t0).count() >= budget_ms)
+			break;
+	}
+
+	if (finished())
+	{
+		total_time = timings.empty() ? 0 : timings.back().ready;
+		for (std::thread& t : workers)
+			t.join();
+		workers.clear();
+	}
+
+	return int(assets.size()) - n_uploaded;
+}
+
+asset_loader::~asset_loader()
+{
+	// the workers stop after their current asset (the assets not started yet are dropped)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		next_load = int(assets.size());
+	}
+	for (std::thread& t : workers)
+		t.join();
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Time spent on an asset (in milliseconds)
+struct asset_timing
+{
+	std::string name;
+	double wait = 0;		// from start to the beginning of the load (waiting for a free worker)
+	double load = 0;		// on a worker thread: decoding, generation
+	double upload = 0;		// on the OpenGL thread
+	double ready = 0;		// from start to the end of the upload
+};
+
+/** Loading of the assets in the background, while the OpenGL thread keeps presenting frames.
+An asset is a load function, run on one of the n_threads worker threads (no OpenGL call), and an upload function,
+run on the OpenGL thread by process_uploads once the load is finished. process_uploads is called every frame:
+it uploads the loaded assets until the time budget is spent (at least one per call), in the order in which they finished loading.
+The assets must all be added before start. Without threads (emscripten), process_uploads also runs the loads, within the same budget.	*/
+struct asset_loader
+{
+	int n_threads = 0;						// worker threads (0 = one per asset, at most the number of hardware threads)
+
+	std::vector<asset_timing> timings;		// uploaded assets, in the order of their upload
+	double total_time = 0;					// from start to the last upload
+
+	void add(std::string const& name, std::function<void()> load, std::function<void()> upload);
+	void start();
+	int process_uploads(double budget_ms);	// return the number of assets not uploaded yet
+	bool finished() const { return n_uploaded == int(assets.size()); }
+	int size() const { return int(assets.size()); }
+
+	~asset_loader();
+
+private:
+	using clock = std::chrono::steady_clock;
+
+	struct asset
+	{
+		asset_timing timing;
+		std::function<void()> load;
+		std::function<void()> upload;
+	};
+
+	std::vector<asset> assets;
+	std::vector<std::thread> workers;
+	clock::time_point start_time;
+	int n_uploaded = 0;
+
+	std::mutex mutex;
+	int next_load = 0;						// next asset to load (protected by mutex)
+	std::deque<int> loaded;					// loaded assets waiting for their upload (protected by mutex)
+
+	void worker();
+	double since_start(clock::time_point t) const;
+};
@@ -0,0 +1,157 @@
+#include "cooked_cubemap.hpp"
+#include "file_system.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+	struct cubemap_header
+	{
+		char magic[8];
+		uint32_t version;
+		int32_t size;
+		int32_t n_levels;
+		int32_t reserved;
+		int64_t source_size;		// size and modification time of the source image
+		int64_t source_time;
+	};
+
+	char const magic[8] = {'L', 'B', 'M', 'C', 'U', 'B', 'E', '1'};
+}
+
+int cooked_cubemap::level_count(int size)
+{
+	int n = 1;
+	while ((size >> (n - 1)) > 1)
+		n++;
+	return n;
+}
+
+size_t cooked_cubemap::level_offset(int level) const
+{
+	size_t offset = 0;
+	for (int l = 0; l < level; l++)
+	{
+		size_t const s = std::max(1, size >> l);
+		offset += 6 * 4 * s * s;
+	}
+	return offset;
+}
+
+bool cooked_cubemap::read(std::string const& path, std::string const& source_path)
+{
+	int64_t file_size = -1, file_time = -1;
+	if (!file_stamp(path, file_size, file_time))
+		return false;
+	FILE* f = std::fopen(path.c_str(), "rb");
+	if (f == nullptr)
+		return false;
+
+	// the header is checked, and must match the length of the file, before allocating anything
+	cubemap_header header;
+	int64_t source_size = -1, source_time = -1;
+	bool ok = std::fread(&header, sizeof(header), 1, f) == 1 && std::memcmp(header.magic, magic, sizeof(magic)) == 0
+		&& header.version == version && header.size > 0 && header.size <= max_size && header.n_levels == level_count(header.size)
+		&& file_stamp(source_path, source_size, source_time) && header.source_size == source_size && header.source_time == source_time;
+
+	if (ok)
+	{
+		size = header.size;
+		n_levels = header.n_levels;
+		ok = file_size == int64_t(sizeof(header) + level_offset(n_levels));
+	}
+	if (ok)
+	{
+		texels.resize(level_offset(n_levels));
+		ok = std::fread(texels.data(), 1, texels.size(), f) == texels.size();
+	}
+	std::fclose(f);
+
+	if (!ok)
+	{
+		size = n_levels = 0;
+		texels.clear();
+	}
+	return ok;
+}
+
+void cooked_cubemap::upload(GLuint texture) const
+{
+	glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	for (int l = 0; l < n_levels; l++)
+	{
+		int const s = std::max(1, size >> l);
+		size_t const face_size = 4 * size_t(s) * s;
+		for (int face = 0; face < 6; face++)
+			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, l, GL_RGBA8, s, s, 0, GL_RGBA, GL_UNSIGNED_BYTE, &texels[level_offset(l) + face * face_size]);
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, n_levels - 1);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+}
+
+#ifndef __EMSCRIPTEN__
+bool cooked_cubemap::cook(GLuint texture, std::string const& path, std::string const& source_path)
+{
+	cubemap_header header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, magic, sizeof(magic));
+	header.version = version;
+	if (!file_stamp(source_path, header.source_size, header.source_time))
+		return false;
+
+	glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+	GLint width = 0;
+	glGetTexLevelParameteriv(GL_TEXTURE_CUBE_MAP_POSITIVE_X, 0, GL_TEXTURE_WIDTH, &width);
+	if (width <= 0 || width > max_size)
+	{
+		glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+		return false;
+	}
+
+	// full mip chain, down to 1x1
+	size = width;
+	n_levels = level_count(size);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, n_levels - 1);
+	glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+
+	texels.resize(level_offset(n_levels));
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	for (int l = 0; l < n_levels; l++)
+	{
+		int const s = std::max(1, size >> l);
+		size_t const face_size = 4 * size_t(s) * s;
+		for (int face = 0; face < 6; face++)
+			glGetTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, l, GL_RGBA, GL_UNSIGNED_BYTE, &texels[level_offset(l) + face * face_size]);
+	}
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+	header.size = size;
+	header.n_levels = n_levels;
+
+	// written to a temporary file, then renamed: a reader never sees a partial file
+	size_t const slash = path.find_last_of('/');
+	if (slash != std::string::npos)
+		create_directories(path.substr(0, slash));
+	std::string const temporary = path + ".tmp";
+	FILE* f = std::fopen(temporary.c_str(), "wb");
+	if (f == nullptr)
+		return false;
+	bool ok = std::fwrite(&header, sizeof(header), 1, f) == 1 && std::fwrite(texels.data(), 1, texels.size(), f) == texels.size();
+	ok = std::fclose(f) == 0 && ok;
+	ok = ok && replace_file(temporary, path);
+	if (!ok)
+		std::remove(temporary.c_str());
+	return ok;
+}
+#endif
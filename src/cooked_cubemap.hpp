@@ -0,0 +1,34 @@
+#pragma once
+
+#include "cgp/cgp.hpp"
+
+#include <string>
+#include <vector>
+
+/** Cubemap stored as the texels of its six faces and their whole mip chain (RGBA8), in the order of the OpenGL face targets,
+so loading it is a file read and one glTexImage2D per face and level (no decoding, no cut, and the mipmaps are not regenerated).
+The cooked file is produced from a texture already on the GPU: cook generates its mipmaps, then reads every level back.
+The file records the size and modification time of the source image, and read rejects it when the source changed.	*/
+struct cooked_cubemap
+{
+	static uint32_t const version = 1;
+	static int const max_size = 16384;	// larger faces are rejected by read (as a corrupt file)
+
+	int size = 0;						// width (= height) of the faces at level 0
+	int n_levels = 0;
+	std::vector<unsigned char> texels;	// level by level, then face by face (+x, -x, +y, -y, +z, -z)
+
+	// (any thread) read the file, return false if it is missing, invalid, or older than the source image
+	bool read(std::string const& path, std::string const& source_path);
+
+	// (OpenGL thread) replace all the faces and levels of the cubemap texture, and enable the trilinear filtering
+	void upload(GLuint texture) const;
+
+#ifndef __EMSCRIPTEN__
+	// (OpenGL thread) generate the mipmaps of the cubemap texture (square faces), read it back and write the file
+	bool cook(GLuint texture, std::string const& path, std::string const& source_path);
+#endif
+
+	size_t level_offset(int level) const;	// offset of the first face of the level in texels
+	static int level_count(int size);		// number of levels of the full mip chain, floor(log2(size)) + 1
+};
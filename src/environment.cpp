@@ -22,12 +22,110 @@ std::string project::path = "";
 
 
 
+// mat4 stored row by row
+static void copy_rows(mat4 const& m, float* data)
+{
+	for (int i = 0; i < 4; i++)
+		for (int j = 0; j < 4; j++)
+			data[4 * i + j] = m(i, j);
+}
+
+environment_uniform_locations& environment_structure::locations_of(opengl_shader_structure const& shader) const
+{
+	auto it = uniform_locations.find(shader.id);
+	if (it != uniform_locations.end())
+		return it->second;
+
+	environment_uniform_locations& locations = uniform_locations[shader.id];
+	locations.projection = glGetUniformLocation(shader.id, "projection");
+	locations.view = glGetUniformLocation(shader.id, "view");
+	locations.light = glGetUniformLocation(shader.id, "light");
+	return locations;
+}
+
 void environment_structure::send_opengl_uniform(opengl_shader_structure const& shader, bool expected) const
 {
-	opengl_uniform(shader, "projection", camera_projection, expected);
-	opengl_uniform(shader, "view", camera_view, expected);
-	opengl_uniform(shader, "light", light, false);
+	environment_uniform_locations& locations = locations_of(shader);
+
+	// (the shaders using the block frame_data have no view/projection uniform: location -1)
+	float m[16];
+	if (locations.projection != -1)
+	{
+		copy_rows(camera_projection, m);
+		glUniformMatrix4fv(locations.projection, 1, GL_TRUE, m);
+	}
+	if (locations.view != -1)
+	{
+		copy_rows(camera_view, m);
+		glUniformMatrix4fv(locations.view, 1, GL_TRUE, m);
+	}
+	if (locations.light != -1)
+		glUniform3f(locations.light, light.x, light.y, light.z);
+
+	// generic uniforms: the locations are resolved once per program (and when a name is added), then read in the order of the maps
+	if (locations.n_float != uniform_generic.uniform_float.size() || locations.n_int != uniform_generic.uniform_int.size() || locations.n_vec3 != uniform_generic.uniform_vec3.size())
+		resolve_generic_locations(shader, locations, expected);
+
+	GLint const* location = locations.generic.data();
+	for (auto const& u : uniform_generic.uniform_float)
+		glUniform1f(*location++, u.second);
+	for (auto const& u : uniform_generic.uniform_int)
+		glUniform1i(*location++, u.second);
+	for (auto const& u : uniform_generic.uniform_vec3)
+		glUniform3f(*location++, u.second.x, u.second.y, u.second.z);
+}
+
+void environment_structure::resolve_generic_locations(opengl_shader_structure const& shader, environment_uniform_locations& locations, bool expected) const
+{
+	locations.generic.clear();
+	auto resolve = [&](std::string const& name) {
+		GLint const location = glGetUniformLocation(shader.id, name.c_str());
+		// same warning as opengl_uniform, only when the location is resolved (so once per program and name)
+		if (location == -1 && expected)
+			warning_cgp("Try to send uniform variable [" + name + "] to a shader that doesn't use it.", "");
+		locations.generic.push_back(location);
+	};
+
+	for (auto const& u : uniform_generic.uniform_float)
+		resolve(u.first);
+	for (auto const& u : uniform_generic.uniform_int)
+		resolve(u.first);
+	for (auto const& u : uniform_generic.uniform_vec3)
+		resolve(u.first);
 
-	uniform_generic.send_opengl_uniform(shader, expected);
+	locations.n_float = uniform_generic.uniform_float.size();
+	locations.n_int = uniform_generic.uniform_int.size();
+	locations.n_vec3 = uniform_generic.uniform_vec3.size();
+}
 
-}
\ No newline at end of file
+void environment_structure::initialize_frame_uniform_buffer()
+{
+	glGenBuffers(1, &frame_ubo);
+	glBindBuffer(GL_UNIFORM_BUFFER, frame_ubo);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(frame_uniform_data), nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	glBindBufferBase(GL_UNIFORM_BUFFER, frame_binding, frame_ubo);
+}
+
+void environment_structure::update_frame_uniform_buffer()
+{
+	copy_rows(camera_view, frame_data.view);
+	copy_rows(camera_projection, frame_data.projection);
+
+	// camera position: -R^T t for the view matrix [R t]
+	for (int i = 0; i < 3; i++)
+		frame_data.camera_position[i] = -(camera_view(0, i) * camera_view(0, 3) + camera_view(1, i) * camera_view(1, 3) + camera_view(2, i) * camera_view(2, 3));
+	frame_data.camera_position[3] = 1.0f;
+
+	glBindBuffer(GL_UNIFORM_BUFFER, frame_ubo);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(frame_uniform_data), &frame_data);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	glBindBufferBase(GL_UNIFORM_BUFFER, frame_binding, frame_ubo);
+}
+
+void environment_structure::attach_frame_uniform_buffer(GLuint program) const
+{
+	GLuint const block = glGetUniformBlockIndex(program, "frame_data");
+	if (block != GL_INVALID_INDEX)
+		glUniformBlockBinding(program, block, frame_binding);
+}
@@ -2,6 +2,9 @@
 
 #include "cgp/cgp.hpp"
 
+#include <unordered_map>
+#include <vector>
+
 using namespace cgp;
 
 // ********************************************************************* //
@@ -9,6 +12,36 @@ using namespace cgp;
 // ********************************************************************* //
 
 
+// Per-frame data of the std140 uniform block "frame_data" (see shading_custom): camera and global lighting parameters.
+// The matrices are stored row by row (the block is declared row_major in the shaders).
+struct frame_uniform_data
+{
+	float view[16];
+	float projection[16];
+	float camera_position[4];		// xyz
+	float ambiant;
+	float diffuse;
+	float specular;
+	float specular_exp;
+	float dl_max;					// maximum distance from which a light is visible
+	float arena_length;				// the light clusters cover [-arena_length/2, arena_length/2]^2
+	int cluster_resolution;			// number of light clusters along one coordinate
+	int data_width;					// number of texels per row of the light textures
+};
+
+// Locations of the uniforms sent by the environment, queried once per shader program
+struct environment_uniform_locations
+{
+	GLint projection = -1;
+	GLint view = -1;
+	GLint light = -1;
+
+	// uniforms of uniform_generic, in the order of their maps (float, then int, then vec3), resolved again when a map grows
+	// (the scene only adds names to uniform_generic, so the same sizes mean the same names)
+	std::vector<GLint> generic;
+	size_t n_float = 0, n_int = 0, n_vec3 = 0;			// sizes of the maps when generic was resolved
+};
+
 // An environment structure contains variables that are needed to the drawing of an element in the scene, but that are not related to a particular shape or mesh.
 // The environment contains typically the camera and the light.
 struct environment_structure : environment_generic_structure
@@ -28,11 +61,26 @@ struct environment_structure : environment_generic_structure
 	// Additional uniforms that can be attached to the environment if needed (empty by default)
 	uniform_generic_structure uniform_generic;
 
+	// Uniform buffer shared by the shaders declaring the block "frame_data" (binding point frame_binding)
+	// frame_data is filled by the scene, then sent in a single buffer update by update_frame_uniform_buffer (once per frame)
+	frame_uniform_data frame_data = {};
+	GLuint frame_ubo = 0;
+	static GLuint const frame_binding = 0;
+
+	void initialize_frame_uniform_buffer();
+	void update_frame_uniform_buffer();							// also copies camera_view and camera_projection
+	void attach_frame_uniform_buffer(GLuint program) const;	// to be called once per shader program using the block
+
 
 	// This function will be called in the draw() call of a drawable element.
 	//  The function is expected to send the uniform variables to the shader (e.g. camera, light)
+	//  The locations of the uniforms are cached per shader program, so no name is looked up in OpenGL on the draw path.
 	void send_opengl_uniform(opengl_shader_structure const& shader, bool expected = default_expected_uniform) const override;
 
+	mutable std::unordered_map<GLuint, environment_uniform_locations> uniform_locations;
+	environment_uniform_locations& locations_of(opengl_shader_structure const& shader) const;
+	void resolve_generic_locations(opengl_shader_structure const& shader, environment_uniform_locations& locations, bool expected) const;
+
 
 };
 
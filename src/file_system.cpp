@@ -0,0 +1,167 @@
+#include "file_system.hpp"
+
+#include <cstdio>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <direct.h>
+#include <sys/stat.h>
+#include <sys/utime.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+bool create_directories(std::string const& path)
+{
+	// every prefix ending at a separator, then the whole path
+	for (size_t k = 1; k <= path.size(); k++)
+	{
+		if (k < path.size() && path[k] != '/' && path[k] != '\\')
+			continue;
+		std::string const prefix = path.substr(0, k);
+#ifdef _WIN32
+		if (prefix.size() == 2 && prefix[1] == ':')		// drive letter
+			continue;
+		_mkdir(prefix.c_str());
+#else
+		mkdir(prefix.c_str(), 0755);
+#endif
+	}
+
+#ifdef _WIN32
+	DWORD const attributes = GetFileAttributesA(path.c_str());
+	return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY);
+#else
+	struct stat st;
+	return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+#endif
+}
+
+bool replace_file(std::string const& source, std::string const& destination)
+{
+#ifdef _WIN32
+	return MoveFileExA(source.c_str(), destination.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	return std::rename(source.c_str(), destination.c_str()) == 0;
+#endif
+}
+
+bool file_stamp(std::string const& path, int64_t& size, int64_t& time)
+{
+#ifdef _WIN32
+	struct _stat64 st;
+	if (_stat64(path.c_str(), &st) != 0)
+		return false;
+#else
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0)
+		return false;
+#endif
+	size = int64_t(st.st_size);
+	time = int64_t(st.st_mtime);
+	return true;
+}
+
+void touch_file(std::string const& path)
+{
+#ifdef _WIN32
+	_utime(path.c_str(), nullptr);
+#else
+	utimes(path.c_str(), nullptr);
+#endif
+}
+
+std::vector<std::pair<int64_t, std::string>> list_files(std::string const& directory)
+{
+	std::vector<std::pair<int64_t, std::string>> files;
+#ifdef _WIN32
+	WIN32_FIND_DATAA entry;
+	HANDLE find = FindFirstFileA((directory + "/*").c_str(), &entry);
+	if (find == INVALID_HANDLE_VALUE)
+		return files;
+	do
+	{
+		if (entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+			continue;
+		int64_t const time = (int64_t(entry.ftLastWriteTime.dwHighDateTime) << 32) | entry.ftLastWriteTime.dwLowDateTime;
+		files.push_back({time, entry.cFileName});
+	} while (FindNextFileA(find, &entry));
+	FindClose(find);
+#else
+	DIR* dir = opendir(directory.c_str());
+	if (dir == nullptr)
+		return files;
+	while (dirent* entry = readdir(dir))
+	{
+		struct stat st;
+		std::string const name = entry->d_name;
+		if (stat((directory + "/" + name).c_str(), &st) == 0 && S_ISREG(st.st_mode))
+			files.push_back({int64_t(st.st_mtime), name});
+	}
+	closedir(dir);
+#endif
+	return files;
+}
+
+bool mapped_file::open(std::string const& path)
+{
+	close();
+#ifdef _WIN32
+	file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		file = nullptr;
+		return false;
+	}
+	LARGE_INTEGER length;
+	if (GetFileSizeEx(file, &length) && length.QuadPart > 0)
+		mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping != nullptr)
+		data = static_cast<char const*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	if (data == nullptr)
+	{
+		close();
+		return false;
+	}
+	size = size_t(length.QuadPart);
+#else
+	int const fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	void* p = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && st.st_size > 0)
+		p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (p == MAP_FAILED)
+		return false;
+	data = static_cast<char const*>(p);
+	size = size_t(st.st_size);
+#endif
+	return true;
+}
+
+void mapped_file::close()
+{
+#ifdef _WIN32
+	if (data != nullptr)
+		UnmapViewOfFile(data);
+	if (mapping != nullptr)
+		CloseHandle(mapping);
+	if (file != nullptr)
+		CloseHandle(file);
+	mapping = file = nullptr;
+#else
+	if (data != nullptr)
+		munmap(const_cast<char*>(data), size);
+#endif
+	data = nullptr;
+	size = 0;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+/** File operations of the caches (levels, shader programs, skybox), for POSIX and Windows.
+The caches write a temporary file, then replace_file it onto the final name, so a reader never sees a partial file.	*/
+
+// create the directory and its missing parents (the path may end with '/'), return true if it exists afterwards
+bool create_directories(std::string const& path);
+// rename source to destination, replacing destination if it exists (std::rename does not replace on Windows)
+bool replace_file(std::string const& source, std::string const& destination);
+// size (in bytes) and modification time of the file, return false if it does not exist
+bool file_stamp(std::string const& path, int64_t& size, int64_t& time);
+// set the modification time of the file to now
+void touch_file(std::string const& path);
+// (modification time, name) of the regular files of the directory
+std::vector<std::pair<int64_t, std::string>> list_files(std::string const& directory);
+
+// Read-only memory map of a whole file
+struct mapped_file
+{
+	char const* data = nullptr;
+	size_t size = 0;
+
+	bool open(std::string const& path);		// return false if the file cannot be mapped (or is empty)
+	void close();
+
+	mapped_file() = default;
+	mapped_file(mapped_file const&) = delete;
+	mapped_file& operator=(mapped_file const&) = delete;
+	~mapped_file() { close(); }
+
+private:
+#ifdef _WIN32
+	void* file = nullptr;
+	void* mapping = nullptr;
+#endif
+};
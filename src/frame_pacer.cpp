@@ -0,0 +1,100 @@
+#include "frame_pacer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <mmsystem.h>
+#endif
+
+frame_pacer::~frame_pacer()
+{
+	set_timer_resolution(false);
+}
+
+void frame_pacer::set_timer_resolution(bool fine)
+{
+	if (fine == fine_timer)
+		return;
+	fine_timer = fine;
+#ifdef _WIN32
+	// the default period of the Windows scheduler is ~15.6 ms, longer than a frame: sleep_until would wake up a frame late
+	if (fine)
+		timeBeginPeriod(1);
+	else
+		timeEndPeriod(1);
+#endif
+}
+
+void frame_pacer::end_frame(bool limit, float fps_max)
+{
+	clock::time_point now = clock::now();
+
+	if (!started)
+	{
+		started = true;
+		deadline = now;
+		last_frame_end = now;
+		frame_times.assign(history_size, 0.0);
+		return;
+	}
+
+	set_timer_resolution(limit);
+
+	if (limit)
+	{
+		auto const period = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1.0 / fps_max));
+		deadline += period;
+
+		if (now > deadline)
+		{
+			// late: do not wait, and restart the schedule from now if we are more than one frame behind
+			missed_deadlines++;
+			if (now > deadline + period)
+				deadline = now;
+		}
+		else
+		{
+			// sleep until the tail, then spin
+			auto const tail = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(spin_tail));
+			if (deadline - now > tail)
+			{
+				clock::time_point const wake_up = deadline - tail;
+				std::this_thread::sleep_until(wake_up);
+
+				double const late = std::chrono::duration<double>(clock::now() - wake_up).count();
+				oversleep = 0.9 * oversleep + 0.1 * std::max(late, 0.0);
+				// no fixed cap: if the OS oversleeps by more than a few ms, the tail grows with it (up to spinning the whole frame)
+				spin_tail = std::min(std::max(2.0 * oversleep, 0.0005), 1.0 / fps_max);
+			}
+			while (clock::now() < deadline) {}
+		}
+		now = clock::now();
+	}
+	else
+		deadline = now;
+
+	record_frame(now);
+}
+
+void frame_pacer::record_frame(clock::time_point now)
+{
+	frame_times[history_index] = std::chrono::duration<double>(now - last_frame_end).count();
+	history_index = (history_index + 1) % history_size;
+	last_frame_end = now;
+	frames++;
+
+	int const n = int(std::min<long>(frames, history_size));
+	double sum = 0.0, sum2 = 0.0;
+	for (int k = 0; k < n; k++)
+	{
+		sum += frame_times[k];
+		sum2 += frame_times[k] * frame_times[k];
+	}
+	mean_frame_time = sum / n;
+	jitter = std::sqrt(std::max(sum2 / n - mean_frame_time * mean_frame_time, 0.0));
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <chrono>
+#include <vector>
+
+/** Frame rate limiter and frame time statistics.
+end_frame is called once per frame, after the buffers are swapped. When limiting, it waits until the deadline of the frame
+(one period after the previous deadline) by sleeping most of the time, then spinning only during a short tail to be accurate.
+The tail adapts to the measured oversleep of the OS, so the CPU is idle almost all the waiting time.
+On Windows, the timer resolution is raised to 1 ms while limiting (timeBeginPeriod, released by timeEndPeriod when the limit is turned
+off or the pacer is destroyed), otherwise the sleeps are rounded to the ~15.6 ms period of the scheduler.	*/
+struct frame_pacer
+{
+	using clock = std::chrono::steady_clock;
+
+	// statistics on the last frames (in seconds)
+	int const history_size = 120;
+	std::vector<double> frame_times;	// duration between the last successive calls to end_frame (ring buffer)
+	int history_index = 0;
+	double mean_frame_time = 0.0;
+	double jitter = 0.0;				// standard deviation of the frame times
+	long frames = 0;
+	long missed_deadlines = 0;			// number of frames that ended after their deadline
+
+	double spin_tail = 0.002;			// duration of the final spin (adapted to the oversleep)
+	double oversleep = 0.001;			// running average of the oversleep
+
+	~frame_pacer();
+	void end_frame(bool limit, float fps_max);
+
+private:
+	clock::time_point deadline;
+	clock::time_point last_frame_end;
+	bool started = false;
+	bool fine_timer = false;			// the timer resolution is raised (Windows only)
+
+	void set_timer_resolution(bool fine);
+
+	void record_frame(clock::time_point now);
+};
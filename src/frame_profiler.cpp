@@ -0,0 +1,189 @@
+#include "frame_profiler.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+void frame_profiler::initialize(std::vector<std::string> const& names)
+{
+	clear();
+	stages.resize(names.size());
+	for (size_t i = 0; i < names.size(); i++)
+	{
+		stages[i].name = names[i];
+		stages[i].cpu.assign(history, -1.0f);
+		stages[i].gpu.assign(history, -1.0f);
+	}
+	frame_times.assign(history, -1.0f);
+	frame = 0;
+
+#ifndef __EMSCRIPTEN__
+	gpu_timing = true;
+	for (stage_data& s : stages)
+		glGenQueries(2, s.queries);
+#endif
+}
+
+void frame_profiler::new_frame()
+{
+	clock::time_point const now = clock::now();
+	if (frame > 0)
+		frame_times[slot()] = std::chrono::duration<float, std::milli>(now - frame_start).count();
+	frame_start = now;
+	frame++;
+	frame_times[slot()] = -1.0f;
+
+	int const buffer = frame % 2;
+	for (stage_data& s : stages)
+	{
+		s.cpu[slot()] = -1.0f;
+		s.gpu[slot()] = -1.0f;
+		s.measured = false;
+
+#ifndef __EMSCRIPTEN__
+		// queries of two frames ago: read only if the GPU is done with them
+		if (!s.issued[buffer])
+			continue;
+		s.issued[buffer] = false;
+
+		GLuint available = 0;
+		glGetQueryObjectuiv(s.queries[buffer], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available)
+		{
+			GLuint64 elapsed = 0;
+			glGetQueryObjectui64v(s.queries[buffer], GL_QUERY_RESULT, &elapsed);
+			s.gpu[(frame - 2 + history) % history] = float(elapsed * 1e-6);
+		}
+#endif
+	}
+}
+
+void frame_profiler::begin(int stage)
+{
+	if (!enabled || frame == 0 || stages[stage].measured)
+		return;
+
+	current = stage;
+#ifndef __EMSCRIPTEN__
+	if (gpu_timing)
+		glBeginQuery(GL_TIME_ELAPSED, stages[stage].queries[frame % 2]);
+#endif
+	stage_start = clock::now();
+}
+
+void frame_profiler::end()
+{
+	if (current < 0)
+		return;
+
+	stage_data& s = stages[current];
+	s.cpu[slot()] = std::chrono::duration<float, std::milli>(clock::now() - stage_start).count();
+	s.measured = true;
+#ifndef __EMSCRIPTEN__
+	if (gpu_timing)
+	{
+		glEndQuery(GL_TIME_ELAPSED);
+		s.issued[frame % 2] = true;
+	}
+#endif
+	current = -1;
+}
+
+profiler_statistics frame_profiler::statistics(std::vector<float> const& samples)
+{
+	std::vector<float> values;
+	values.reserve(samples.size());
+	for (float v : samples)
+		if (v >= 0)
+			values.push_back(v);
+
+	profiler_statistics result;
+	result.n_samples = int(values.size());
+	if (values.empty())
+		return result;
+
+	double sum = 0;
+	for (float v : values)
+		sum += v;
+	result.average = sum / values.size();
+
+	// nearest-rank percentile
+	size_t const rank = size_t(std::ceil(0.99 * values.size())) - 1;
+	std::nth_element(values.begin(), values.begin() + rank, values.end());
+	result.p99 = values[rank];
+	result.max = *std::max_element(values.begin() + rank, values.end());
+	return result;
+}
+
+profiler_statistics frame_profiler::cpu_statistics(int stage) const
+{
+	return statistics(stages[stage].cpu);
+}
+
+profiler_statistics frame_profiler::gpu_statistics(int stage) const
+{
+	return statistics(stages[stage].gpu);
+}
+
+profiler_statistics frame_profiler::frame_statistics() const
+{
+	return statistics(frame_times);
+}
+
+void frame_profiler::display_gui()
+{
+	if (!ImGui::CollapsingHeader("Profiler"))
+		return;
+
+	ImGui::Indent();
+	ImGui::Checkbox("Measure", &enabled);
+
+	profiler_statistics const frame_stats = frame_statistics();
+	ImGui::Text("Frame: %.2f ms average, %.2f ms p99, %.2f ms max (%d frames)", frame_stats.average, frame_stats.p99, frame_stats.max, frame_stats.n_samples);
+
+	// frame times in chronological order (the current frame is not finished)
+	std::vector<float> graph(history - 1);
+	float graph_max = 1.0f;
+	for (int k = 0; k < history - 1; k++)
+	{
+		graph[k] = std::max(frame_times[(frame + 1 + k) % history], 0.0f);
+		graph_max = std::max(graph_max, graph[k]);
+	}
+	ImGui::PlotLines("##frame_times", graph.data(), history - 1, 0, "frame time (ms)", 0.0f, graph_max, ImVec2(0, 60));
+
+	// the default font of ImGui is monospace, so the columns are aligned with the text format
+	ImGui::Text("%-20s %17s %17s", "", "CPU avg / p99", gpu_timing ? "GPU avg / p99" : "GPU");
+	double cpu_total = 0, gpu_total = 0;
+	for (int i = 0; i < int(stages.size()); i++)
+	{
+		profiler_statistics const cpu = cpu_statistics(i);
+		profiler_statistics const gpu = gpu_statistics(i);
+		if (cpu.n_samples == 0)
+		{
+			ImGui::Text("%-20s %17s %17s", stages[i].name.c_str(), "-", "-");
+			continue;
+		}
+
+		// stages measured in some frames only (e.g. the parabola) count in the totals in proportion
+		cpu_total += cpu.average * cpu.n_samples / history;
+		gpu_total += gpu.average * gpu.n_samples / history;
+
+		char gpu_text[32] = "-";
+		if (gpu.n_samples > 0)
+			std::snprintf(gpu_text, sizeof(gpu_text), "%7.3f / %7.3f", gpu.average, gpu.p99);
+		ImGui::Text("%-20s %7.3f / %7.3f %17s", stages[i].name.c_str(), cpu.average, cpu.p99, gpu_text);
+	}
+	ImGui::Text("%-20s %7.3f %27.3f", "total", cpu_total, gpu_total);
+	ImGui::Unindent();
+}
+
+void frame_profiler::clear()
+{
+#ifndef __EMSCRIPTEN__
+	for (stage_data& s : stages)
+		if (s.queries[0] != 0)
+			glDeleteQueries(2, s.queries);
+#endif
+	stages.clear();
+	current = -1;
+}
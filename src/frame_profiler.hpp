@@ -0,0 +1,61 @@
+#pragma once
+
+#include "cgp/cgp.hpp"
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+// Rolling statistics of one stage (in milliseconds)
+struct profiler_statistics
+{
+	int n_samples = 0;			// frames in the window where the stage was measured
+	double average = 0;
+	double p99 = 0;
+	double max = 0;
+};
+
+/** CPU and GPU time spent in each stage of a frame, over the last history frames.
+A stage is measured between begin and end, at most once per frame, and the stages must not overlap (a GL_TIME_ELAPSED query cannot be nested).
+The GPU time comes from GL_TIME_ELAPSED queries, double-buffered: the queries issued in frame f are read at the start of frame f+2,
+only if their result is available, so measuring never waits for the GPU (a result still pending is dropped).
+Without timer queries (emscripten), only the CPU time is measured.	*/
+struct frame_profiler
+{
+	bool enabled = true;
+	int history = 240;						// number of frames of the statistics (set before initialize)
+
+	// names of the stages (the index of a stage is its position in names)
+	void initialize(std::vector<std::string> const& names);
+	void new_frame();						// to be called at the start of every frame, before the first begin
+	void begin(int stage);
+	void end();
+
+	profiler_statistics cpu_statistics(int stage) const;
+	profiler_statistics gpu_statistics(int stage) const;
+	profiler_statistics frame_statistics() const;	// time between two calls to new_frame
+
+	void display_gui();						// table of the statistics and graph of the frame times
+	void clear();							// release the queries
+
+private:
+	using clock = std::chrono::steady_clock;
+
+	struct stage_data
+	{
+		std::string name;
+		std::vector<float> cpu, gpu;		// one sample per frame (ring buffers, -1 when not measured)
+		GLuint queries[2] = {0, 0};			// double-buffered GL_TIME_ELAPSED queries
+		bool issued[2] = {false, false};	// queries[b] was issued and not read yet
+		bool measured = false;				// already measured in the current frame
+	};
+	std::vector<stage_data> stages;
+	std::vector<float> frame_times;			// ring buffer of the frame times
+	int frame = 0;							// number of calls to new_frame
+	int current = -1;						// stage between begin and end
+	clock::time_point stage_start, frame_start;
+	bool gpu_timing = false;
+
+	int slot() const { return frame % history; }
+	static profiler_statistics statistics(std::vector<float> const& samples);
+};
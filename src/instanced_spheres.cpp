@@ -0,0 +1,107 @@
+#include "instanced_spheres.hpp"
+
+#include <algorithm>
+
+using namespace cgp;
+
+static int const instance_floats = 7;		// center (3), radius (1), color (3)
+
+void instanced_spheres_drawable::initialize_data_on_gpu(mesh const& sphere, opengl_shader_structure const& shader_arg)
+{
+	shader = shader_arg;
+	n_indices = 3 * int(sphere.connectivity.size());
+
+	phong_locations[0] = glGetUniformLocation(shader.id, "phong_ambient");
+	phong_locations[1] = glGetUniformLocation(shader.id, "phong_diffuse");
+	phong_locations[2] = glGetUniformLocation(shader.id, "phong_specular");
+	phong_locations[3] = glGetUniformLocation(shader.id, "phong_specular_exponent");
+
+	glGenVertexArrays(1, &vao);
+	glBindVertexArray(vao);
+
+	// shared geometry: positions (location 0), normals (location 1) and triangles
+	glGenBuffers(1, &vbo_position);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo_position);
+	glBufferData(GL_ARRAY_BUFFER, sphere.position.size() * sizeof(vec3), &sphere.position[0], GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+
+	glGenBuffers(1, &vbo_normal);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo_normal);
+	glBufferData(GL_ARRAY_BUFFER, sphere.normal.size() * sizeof(vec3), &sphere.normal[0], GL_STATIC_DRAW);
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+
+	glGenBuffers(1, &ebo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sphere.connectivity.size() * sizeof(uint3), &sphere.connectivity[0], GL_STATIC_DRAW);
+
+	// per-instance data: center and radius (location 4), color (location 5), allocated by update_instances
+	glGenBuffers(1, &vbo_instances);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo_instances);
+	GLsizei const stride = instance_floats * sizeof(float);
+	glEnableVertexAttribArray(4);
+	glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, stride, nullptr);
+	glVertexAttribDivisor(4, 1);
+	glEnableVertexAttribArray(5);
+	glVertexAttribPointer(5, 3, GL_FLOAT, GL_FALSE, stride, (void*)(4 * sizeof(float)));
+	glVertexAttribDivisor(5, 1);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	n_instances = 0;
+	capacity = 0;
+}
+
+void instanced_spheres_drawable::update_instances(std::vector<vec3> const& centers, std::vector<float> const& radii, std::vector<vec3> const& colors)
+{
+	n_instances = int(centers.size());
+	instance_data.resize(instance_floats * n_instances);
+	for (int i = 0; i < n_instances; i++)
+	{
+		float* d = &instance_data[instance_floats * i];
+		d[0] = centers[i].x; d[1] = centers[i].y; d[2] = centers[i].z;
+		d[3] = radii[i];
+		d[4] = colors[i].x; d[5] = colors[i].y; d[6] = colors[i].z;
+	}
+	if (n_instances == 0)
+		return;
+
+	glBindBuffer(GL_ARRAY_BUFFER, vbo_instances);
+	if (n_instances > capacity)
+	{
+		capacity = std::max(n_instances, 2 * capacity);
+		glBufferData(GL_ARRAY_BUFFER, capacity * instance_floats * sizeof(float), nullptr, GL_DYNAMIC_DRAW);
+	}
+	glBufferSubData(GL_ARRAY_BUFFER, 0, instance_data.size() * sizeof(float), instance_data.data());
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void instanced_spheres_drawable::draw(environment_structure const& environment) const
+{
+	if (n_instances == 0 || vao == 0)
+		return;
+
+	glUseProgram(shader.id);
+	environment.send_opengl_uniform(shader, false);
+	glUniform1f(phong_locations[0], ambient);
+	glUniform1f(phong_locations[1], diffuse);
+	glUniform1f(phong_locations[2], specular);
+	glUniform1f(phong_locations[3], specular_exponent);
+
+	glBindVertexArray(vao);
+	glDrawElementsInstanced(GL_TRIANGLES, n_indices, GL_UNSIGNED_INT, nullptr, n_instances);
+	glBindVertexArray(0);
+	glUseProgram(0);
+}
+
+void instanced_spheres_drawable::clear()
+{
+	glDeleteBuffers(1, &vbo_position);
+	glDeleteBuffers(1, &vbo_normal);
+	glDeleteBuffers(1, &ebo);
+	glDeleteBuffers(1, &vbo_instances);
+	glDeleteVertexArrays(1, &vao);
+	vbo_position = vbo_normal = ebo = vbo_instances = vao = 0;
+	n_instances = capacity = 0;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "cgp/cgp.hpp"
+#include "environment.hpp"
+
+/** Spheres sharing a single mesh, drawn with one instanced draw call (shaders/instanced_sphere).
+The unit sphere is uploaded once; each sphere is an instance of 7 floats (center, radius, color) in a second buffer
+read with a divisor of 1. update_instances rewrites this buffer every frame (it only grows), so moving or recoloring
+the spheres costs one buffer update instead of one draw call (and its uniforms) per sphere.
+The shader reads the camera in the frame uniform block: the block must be attached to shader and updated before draw.	*/
+struct instanced_spheres_drawable
+{
+	GLuint vao = 0;
+	GLuint vbo_position = 0;
+	GLuint vbo_normal = 0;
+	GLuint ebo = 0;
+	GLuint vbo_instances = 0;
+
+	cgp::opengl_shader_structure shader;
+
+	// Phong coefficients of all the spheres (defaults of the cgp materials)
+	float ambient = 0.3f;
+	float diffuse = 0.6f;
+	float specular = 0.1f;
+	float specular_exponent = 64.0f;
+
+	int n_indices = 0;			// 3 * number of triangles of the sphere
+	int n_instances = 0;
+	int capacity = 0;			// number of instances the buffer can hold
+
+	void initialize_data_on_gpu(cgp::mesh const& sphere, cgp::opengl_shader_structure const& shader);
+	void update_instances(std::vector<cgp::vec3> const& centers, std::vector<float> const& radii, std::vector<cgp::vec3> const& colors);
+	void draw(environment_structure const& environment) const;
+	void clear();
+
+private:
+	std::vector<float> instance_data;		// data of the last update (kept to avoid allocations)
+	GLint phong_locations[4] = {-1, -1, -1, -1};
+};
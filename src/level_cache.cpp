@@ -0,0 +1,255 @@
+#include "level_cache.hpp"
+#include "file_system.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+using namespace cgp;
+
+namespace
+{
+	// Everything the generated data depends on
+	struct level_key
+	{
+		uint32_t version;
+		int32_t N;
+		float length;
+		float bump_cutoff;
+		int32_t n_bumps;
+		uint32_t random_key[2];
+		int32_t cache_resolution;
+		int32_t cache_bicubic;
+		int32_t build_mesh;
+	};
+
+	// Layout of a file: header, then the sections in this order, each starting at a multiple of 16 bytes:
+	// bump positions (vec2), heights, widths, height cache (float), positions, normals (vec3), triangles (uint3)
+	struct level_header
+	{
+		char magic[8];
+		level_key key;
+		uint32_t n_vertices;
+		uint32_t n_triangles;
+		uint32_t n_cache_samples;
+		float cache_max_error;
+	};
+
+	char const magic[8] = {'L', 'B', 'M', 'L', 'E', 'V', 'E', 'L'};
+
+	size_t align16(size_t n) { return (n + 15) & ~size_t(15); }
+
+	level_key make_key(Terrain const& terrain, int N, float length, int n_bumps)
+	{
+		level_key key;
+		std::memset(&key, 0, sizeof(key));
+		key.version = level_cache::version;
+		key.N = N;
+		key.length = length;
+		key.bump_cutoff = terrain.bump_cutoff;
+		key.n_bumps = n_bumps;
+		key.random_key[0] = terrain.random.key[0];
+		key.random_key[1] = terrain.random.key[1];
+		key.cache_resolution = terrain.cache_resolution > 1 ? terrain.cache_resolution : 0;
+		key.cache_bicubic = terrain.cache_bicubic;
+		key.build_mesh = terrain.build_mesh;
+		return key;
+	}
+
+	// sizes of the sections (in bytes)
+	struct level_sections
+	{
+		size_t sizes[7];
+		size_t total() const
+		{
+			size_t n = align16(sizeof(level_header));
+			for (size_t s : sizes)
+				n += align16(s);
+			return n;
+		}
+	};
+
+	level_sections sections_of(level_header const& h)
+	{
+		int const b = h.key.n_bumps;
+		return {{b * sizeof(vec2), b * sizeof(float), b * sizeof(float), h.n_cache_samples * sizeof(float),
+			h.n_vertices * sizeof(vec3), h.n_vertices * sizeof(vec3), h.n_triangles * sizeof(uint3)}};
+	}
+
+	double elapsed_ms(std::chrono::steady_clock::time_point t0)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+	}
+}
+
+std::string level_cache::file_name(Terrain const& terrain, int N, float length, int n_bumps) const
+{
+	// FNV-1a hash of the key
+	level_key const key = make_key(terrain, N, length, n_bumps);
+	unsigned char const* bytes = reinterpret_cast<unsigned char const*>(&key);
+	uint64_t hash = 14695981039346656037ull;
+	for (size_t i = 0; i < sizeof(key); i++)
+		hash = (hash ^ bytes[i]) * 1099511628211ull;
+
+	char name[32];
+	std::snprintf(name, sizeof(name), "level_%016llx.bin", (unsigned long long)hash);
+	return directory + name;
+}
+
+bool level_cache::create_terrain(Terrain& terrain, int N, float length, int n_bumps)
+{
+	if (load(terrain, N, length, n_bumps))
+		return true;
+
+	terrain.create_terrain_mesh(N, length, n_bumps);
+	save(terrain);
+	return false;
+}
+
+#ifndef __EMSCRIPTEN__
+
+bool level_cache::load(Terrain& terrain, int N, float length, int n_bumps)
+{
+	if (!enabled)
+		return false;
+
+	auto const t0 = std::chrono::steady_clock::now();
+
+	std::string const path = file_name(terrain, N, length, n_bumps);
+	mapped_file file;
+	if (!file.open(path) || file.size < sizeof(level_header))
+		return false;
+
+	// check the key and the size before using anything
+	char const* bytes = file.data;
+	level_header header;
+	std::memcpy(&header, bytes, sizeof(header));
+	level_key const key = make_key(terrain, N, length, n_bumps);
+	bool const valid = std::memcmp(header.magic, magic, sizeof(magic)) == 0 && std::memcmp(&header.key, &key, sizeof(key)) == 0
+		&& header.n_cache_samples == uint32_t(key.cache_resolution * key.cache_resolution)
+		&& file.size == sections_of(header).total();
+	if (!valid)
+		return false;
+
+	// bulk copies from the mapped pages
+	level_sections const sections = sections_of(header);
+	size_t offset = align16(sizeof(level_header));
+	auto section = [&](int k) {
+		char const* p = bytes + offset;
+		offset += align16(sections.sizes[k]);
+		return p;
+	};
+	auto copy = [](auto& v, char const* p, size_t n) {
+		using T = typename std::decay<decltype(v[0])>::type;
+		T const* first = reinterpret_cast<T const*>(p);
+		v.assign(first, first + n);
+	};
+
+	terrain.N = N;
+	terrain.n_bumps = n_bumps;
+	terrain.terrain_length = length;
+	copy(terrain.p_i, section(0), n_bumps);
+	copy(terrain.h_i, section(1), n_bumps);
+	copy(terrain.s_i, section(2), n_bumps);
+	copy(terrain.height_cache, section(3), header.n_cache_samples);
+	terrain.cache_max_error = header.cache_max_error;
+	terrain.cache_cell_error.clear();		// measured again by the first edit
+
+	mesh& m = terrain.mesh;
+	m = mesh();
+	copy(m.position.data, section(4), header.n_vertices);
+	copy(m.normal.data, section(5), header.n_vertices);
+	copy(m.connectivity.data, section(6), header.n_triangles);
+	m.color.data.assign(header.n_vertices, vec3{1, 1, 1});
+	m.uv.data.assign(header.n_vertices, vec2{0.0f, 0.0f});
+
+	file.close();
+
+	// the file is now the most recently used (see remove_old_files)
+	touch_file(path);
+
+	terrain.update_bump_arrays();
+	terrain.build_bump_index();
+
+	last_load_time = elapsed_ms(t0);
+	return true;
+}
+
+bool level_cache::save(Terrain const& terrain)
+{
+	if (!enabled)
+		return false;
+
+	auto const t0 = std::chrono::steady_clock::now();
+	create_directories(directory);
+
+	level_header header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, magic, sizeof(magic));
+	header.key = make_key(terrain, terrain.N, terrain.terrain_length, terrain.n_bumps);
+	header.n_vertices = uint32_t(terrain.mesh.position.size());
+	header.n_triangles = uint32_t(terrain.mesh.connectivity.size());
+	header.n_cache_samples = uint32_t(terrain.height_cache.size());
+	header.cache_max_error = terrain.cache_max_error;
+	if (header.n_cache_samples != uint32_t(header.key.cache_resolution * header.key.cache_resolution))
+		return false;
+
+	// written to a temporary file, then renamed: a reader never sees a partial file
+	std::string const path = file_name(terrain, terrain.N, terrain.terrain_length, terrain.n_bumps);
+	std::string const temporary = path + ".tmp";
+	FILE* f = std::fopen(temporary.c_str(), "wb");
+	if (f == nullptr)
+		return false;
+
+	level_sections const sections = sections_of(header);
+	void const* data[7] = {terrain.p_i.data(), terrain.h_i.data(), terrain.s_i.data(), terrain.height_cache.data(),
+		terrain.mesh.position.data.data(), terrain.mesh.normal.data.data(), terrain.mesh.connectivity.data.data()};
+	char const padding[16] = {};
+
+	bool ok = std::fwrite(&header, sizeof(header), 1, f) == 1;
+	ok = ok && std::fwrite(padding, 1, align16(sizeof(header)) - sizeof(header), f) == align16(sizeof(header)) - sizeof(header);
+	for (int k = 0; k < 7 && ok; k++)
+	{
+		size_t const pad = align16(sections.sizes[k]) - sections.sizes[k];
+		ok = (sections.sizes[k] == 0 || std::fwrite(data[k], 1, sections.sizes[k], f) == sections.sizes[k]) && std::fwrite(padding, 1, pad, f) == pad;
+	}
+	ok = std::fclose(f) == 0 && ok;
+	ok = ok && replace_file(temporary, path);
+	if (!ok)
+	{
+		std::remove(temporary.c_str());
+		return false;
+	}
+
+	remove_old_files();
+	last_save_time = elapsed_ms(t0);
+	return true;
+}
+
+void level_cache::remove_old_files() const
+{
+	// (modification time, path) of the level files: the time of the last save or load
+	std::vector<std::pair<int64_t, std::string>> files;
+	for (auto const& file : list_files(directory))
+	{
+		std::string const& name = file.second;
+		if (name.compare(0, 6, "level_") != 0 || name.size() < 4 || name.compare(name.size() - 4, 4, ".bin") != 0)
+			continue;
+		files.push_back({file.first, directory + name});
+	}
+
+	if (int(files.size()) <= max_files)
+		return;
+	std::sort(files.begin(), files.end());
+	for (int k = 0; k < int(files.size()) - max_files; k++)
+		std::remove(files[k].second.c_str());
+}
+
+#else
+
+bool level_cache::load(Terrain&, int, float, int) { return false; }
+bool level_cache::save(Terrain const&) { return false; }
+void level_cache::remove_old_files() const {}
+
+#endif
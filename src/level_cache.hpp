@@ -0,0 +1,37 @@
+#pragma once
+
+#include "terrain.hpp"
+
+#include <string>
+
+/** Binary cache of the generated levels, in directory (one file per level).
+A file holds the bumps, the height cache and the mesh buffers (positions, normals, triangles) of a terrain, in the layout of the GPU buffers,
+so loading a level is a memory map (see file_system.hpp) plus a few bulk copies into terrain.mesh (kept for the edits), with no evaluation of the terrain.
+The files are keyed by everything that changes the generated data: N, the length, the cutoff and the number of bumps, the random stream of the bumps,
+the height cache settings, whether the mesh is built, and the format version (level_cache::version, to increase when the generation changes).
+The name of a file is a hash of the key, and the key is also stored in the file and compared when loading (collisions are rejected).
+The cache keeps the max_files most recently used files. It is disabled with emscripten (no persistent file system).	*/
+struct level_cache
+{
+	static uint32_t const version = 3;		// 2: per-point cutoff of the bumps, 3: cutoff in the key
+
+	std::string directory = "cache/";
+	bool enabled = true;
+	int max_files = 8;
+
+	// time spent in the last load or save (in milliseconds)
+	double last_load_time = 0;
+	double last_save_time = 0;
+
+	// generate the terrain as terrain.create_terrain_mesh(N, length, n_bumps) would, from the cache if possible (then save it)
+	// return true if the level was read from the cache
+	bool create_terrain(Terrain& terrain, int N, float length, int n_bumps);
+
+	bool load(Terrain& terrain, int N, float length, int n_bumps);
+	bool save(Terrain const& terrain);
+
+	std::string file_name(Terrain const& terrain, int N, float length, int n_bumps) const;
+
+private:
+	void remove_old_files() const;
+};
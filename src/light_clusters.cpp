@@ -0,0 +1,158 @@
+#include "light_clusters.hpp"
+
+#include <algorithm>
+
+using namespace cgp;
+
+static GLuint create_data_texture()
+{
+	GLuint texture = 0;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	// integer textures are incomplete with linear filtering, and the data is only read with texelFetch
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	return texture;
+}
+
+void light_clusters::initialize(float arena_length_arg, int resolution_arg)
+{
+	arena_length = arena_length_arg;
+	resolution = resolution_arg;
+
+	light_texture = create_data_texture();
+	cluster_texture = create_data_texture();
+	index_texture = create_data_texture();
+	allocated_rows = {0, 0, 0};
+}
+
+void light_clusters::update(std::vector<vec3> const& positions, std::vector<vec3> const& colors, float radius)
+{
+	int const R = resolution;
+	float const cell = arena_length / R;
+	n_lights = int(positions.size());
+
+	// lights: (x, y, z, 0) then (r, g, b, 0)
+	light_data.assign(8 * std::max(n_lights, 1), 0.0f);
+	for (int i = 0; i < n_lights; i++)
+	{
+		light_data[8 * i + 0] = positions[i].x;
+		light_data[8 * i + 1] = positions[i].y;
+		light_data[8 * i + 2] = positions[i].z;
+		light_data[8 * i + 4] = colors[i].x;
+		light_data[8 * i + 5] = colors[i].y;
+		light_data[8 * i + 6] = colors[i].z;
+	}
+
+	// clusters overlapped by the disk of radius `radius` around the light (clamped to the grid, as the fragments outside the arena)
+	auto cell_range = [&](float a, int& c_min, int& c_max) {
+		c_min = std::max(0, std::min(R - 1, int(std::floor((a - radius) / cell + R / 2.0f))));
+		c_max = std::max(0, std::min(R - 1, int(std::floor((a + radius) / cell + R / 2.0f))));
+	};
+	auto overlaps = [&](vec3 const& p, int cu, int cv) {
+		float x_min = (cu - R / 2.0f) * cell, y_min = (cv - R / 2.0f) * cell;
+		// the border clusters extend to infinity outside the arena
+		float dx = (cu == 0 && p.x < x_min) || (cu == R - 1 && p.x > x_min + cell) ? 0.0f : p.x - std::max(x_min, std::min(p.x, x_min + cell));
+		float dy = (cv == 0 && p.y < y_min) || (cv == R - 1 && p.y > y_min + cell) ? 0.0f : p.y - std::max(y_min, std::min(p.y, y_min + cell));
+		return dx * dx + dy * dy <= radius * radius;
+	};
+
+	// counting sort of the (cluster, light) pairs: count, prefix sum, then fill
+	cluster_data.assign(2 * R * R, 0);
+	for (int i = 0; i < n_lights; i++)
+	{
+		int u0, u1, v0, v1;
+		cell_range(positions[i].x, u0, u1);
+		cell_range(positions[i].y, v0, v1);
+		for (int cu = u0; cu <= u1; cu++)
+			for (int cv = v0; cv <= v1; cv++)
+				if (overlaps(positions[i], cu, cv))
+					cluster_data[2 * (cv * R + cu) + 1]++;
+	}
+
+	n_indices = 0;
+	for (int c = 0; c < R * R; c++)
+	{
+		cluster_data[2 * c] = n_indices;
+		n_indices += cluster_data[2 * c + 1];
+		cluster_data[2 * c + 1] = 0;
+	}
+
+	index_data.assign(std::max(n_indices, 1), 0);
+	for (int i = 0; i < n_lights; i++)
+	{
+		int u0, u1, v0, v1;
+		cell_range(positions[i].x, u0, u1);
+		cell_range(positions[i].y, v0, v1);
+		for (int cu = u0; cu <= u1; cu++)
+			for (int cv = v0; cv <= v1; cv++)
+				if (overlaps(positions[i], cu, cv))
+				{
+					int const c = cv * R + cu;
+					index_data[cluster_data[2 * c] + cluster_data[2 * c + 1]++] = i;
+				}
+	}
+
+	upload(light_texture, 0, GL_RGBA32F, GL_RGBA, GL_FLOAT, light_data.data(), 2 * std::max(n_lights, 1), 4);
+	upload(cluster_texture, 1, GL_RG32I, GL_RG_INTEGER, GL_INT, cluster_data.data(), R * R, 2);
+	upload(index_texture, 2, GL_R32I, GL_RED_INTEGER, GL_INT, index_data.data(), std::max(n_indices, 1), 1);
+}
+
+void light_clusters::upload(GLuint texture, int slot, GLint internal_format, GLenum format, GLenum type, void const* data, int n_texels, int components)
+{
+	int const W = texture_width;
+	int const rows = (n_texels + W - 1) / W;
+	int const element_size = (type == GL_FLOAT ? sizeof(float) : sizeof(int)) * components;
+
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+	// the texture only grows (by doubling its number of rows), so most frames only update its content
+	if (rows > allocated_rows[slot])
+	{
+		allocated_rows[slot] = std::max(rows, 2 * allocated_rows[slot]);
+		glTexImage2D(GL_TEXTURE_2D, 0, internal_format, W, allocated_rows[slot], 0, format, type, nullptr);
+	}
+
+	// full rows, then the last partial row
+	int const full_rows = n_texels / W;
+	if (full_rows > 0)
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, W, full_rows, format, type, data);
+	int const remaining = n_texels - full_rows * W;
+	if (remaining > 0)
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, full_rows, remaining, 1, format, type, static_cast<char const*>(data) + size_t(full_rows) * W * element_size);
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void light_clusters::attach(GLuint program, int first_unit) const
+{
+	glUseProgram(program);
+	glUniform1i(glGetUniformLocation(program, "light_data"), first_unit);
+	glUniform1i(glGetUniformLocation(program, "light_clusters"), first_unit + 1);
+	glUniform1i(glGetUniformLocation(program, "light_indices"), first_unit + 2);
+	glUseProgram(0);
+}
+
+void light_clusters::bind(int first_unit) const
+{
+	GLuint const textures[3] = {light_texture, cluster_texture, index_texture};
+	for (int k = 0; k < 3; k++)
+	{
+		glActiveTexture(GL_TEXTURE0 + first_unit + k);
+		glBindTexture(GL_TEXTURE_2D, textures[k]);
+	}
+	glActiveTexture(GL_TEXTURE0);
+}
+
+void light_clusters::clear()
+{
+	glDeleteTextures(1, &light_texture);
+	glDeleteTextures(1, &cluster_texture);
+	glDeleteTextures(1, &index_texture);
+	light_texture = cluster_texture = index_texture = 0;
+	allocated_rows = {0, 0, 0};
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "cgp/cgp.hpp"
+
+/** Lights of the scene grouped by 2D clusters for the shading_custom shader.
+The lights hover near the ground, so the arena [-length/2, length/2]^2 is split into resolution*resolution columns (infinite along z).
+Every frame, update lists for each cluster the lights whose sphere of influence (radius dl_max) overlaps it in (x,y),
+and uploads three textures read with texelFetch (the grid parameters are in the frame uniform block):
+	- the lights: two RGBA32F texels per light (position, then color),
+	- the clusters: one RG32I texel per cluster (offset and number of its lights in the index texture),
+	- the light indices of all the clusters (R32I).
+A fragment then only loops over the lights of its cluster. The textures are 2D (texture_width texels per row)
+rather than buffer textures, so they are also available with OpenGL ES 3 / WebGL 2.	*/
+struct light_clusters
+{
+	int resolution = 32;				// number of clusters along one coordinate
+	float arena_length = 100.0f;
+	int const texture_width = 1024;
+
+	GLuint light_texture = 0;
+	GLuint cluster_texture = 0;
+	GLuint index_texture = 0;
+
+	// statistics of the last update
+	int n_lights = 0;
+	int n_indices = 0;					// sum of the number of lights of each cluster
+
+	void initialize(float arena_length, int resolution);
+	void update(std::vector<cgp::vec3> const& positions, std::vector<cgp::vec3> const& colors, float radius);
+
+	// set the sampler uniforms of the program to the units first_unit .. first_unit+2 (once per program)
+	void attach(GLuint program, int first_unit) const;
+	// bind the textures on the units first_unit .. first_unit+2 (every frame)
+	void bind(int first_unit) const;
+	void clear();
+
+private:
+	// data of the last update (kept to avoid allocations)
+	std::vector<float> light_data;
+	std::vector<int> cluster_data;		// (offset, count) per cluster
+	std::vector<int> index_data;
+	std::vector<int> allocated_rows = {0, 0, 0};
+
+	void upload(GLuint texture, int slot, GLint internal_format, GLenum format, GLenum type, void const* data, int n_texels, int components);
+};
@@ -0,0 +1,113 @@
+#include "light_swarm.hpp"
+#include "parallel.hpp"
+
+#include <chrono>
+#include <cmath>
+
+using namespace cgp;
+
+// independent draws for the initial state and the updates (third index of random_stream::bits)
+static uint32_t const stream_initialize = 0;
+static uint32_t const stream_update = 1;
+
+void light_swarm::initialize(Terrain const& terrain, int n, float boundary_arg, random_stream const& random_arg)
+{
+	boundary = boundary_arg;
+	random = random_arg;
+	update_count = 0;
+
+	x.resize(n); y.resize(n); z.resize(n);
+	dx.resize(n); dy.resize(n); dz.resize(n);
+	rx.resize(n); ry.resize(n); rz.resize(n);
+
+	for (int i = 0; i < n; i++)
+	{
+		std::array<uint32_t, 4> const r = random.bits(i, 0, stream_initialize);
+		x[i] = random_float(r[0], -boundary, boundary);
+		y[i] = random_float(r[1], -boundary, boundary);
+	}
+
+	// initial directions: a first draw of the update stream
+	random_directions(0, n);
+	for (int i = 0; i < n; i++)
+	{
+		dx[i] = rx[i]; dy[i] = ry[i]; dz[i] = rz[i];
+	}
+	update_count = 1;
+
+	follow_terrain(terrain, 0, n);
+}
+
+void light_swarm::update(Terrain const& terrain, float dt)
+{
+	auto const t0 = std::chrono::steady_clock::now();
+
+	int const n = size();
+	int const n_bands = std::max(1, std::min(parallel_thread_count(n_threads), n / std::max(min_lights_per_thread, 1)));
+
+	workers.for_bands(n, n_bands, [&](int begin, int end)
+	{
+		random_directions(begin, end);
+		move(begin, end, dt);
+		follow_terrain(terrain, begin, end);
+	});
+	update_count++;
+
+	last_update_time = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - t0).count();
+}
+
+void light_swarm::random_directions(int begin, int end)
+{
+	for (int i = begin; i < end; i++)
+	{
+		// uniform in the cube [-1,1]^3, then normalized
+		std::array<uint32_t, 4> const r = random.bits(i, update_count, stream_update);
+		float const u = random_float(r[0], -1.0f, 1.0f);
+		float const v = random_float(r[1], -1.0f, 1.0f);
+		float const w = random_float(r[2], -1.0f, 1.0f);
+		float const inv_norm = 1.0f / std::max(std::sqrt(u * u + v * v + w * w), 1e-6f);
+		rx[i] = u * inv_norm;
+		ry[i] = v * inv_norm;
+		rz[i] = w * inv_norm;
+	}
+}
+
+void light_swarm::move(int begin, int end, float dt)
+{
+	float const a = inertia, b = 1.0f - inertia;
+	float const step = dt * speed;
+
+	// no branch in this loop: it is vectorized
+	for (int i = begin; i < end; i++)
+	{
+		float u = a * dx[i] + b * rx[i];
+		float v = a * dy[i] + b * ry[i];
+		float w = a * dz[i] + b * rz[i];
+		float const inv_norm = 1.0f / std::max(std::sqrt(u * u + v * v + w * w), 1e-6f);
+		u *= inv_norm; v *= inv_norm; w *= inv_norm;
+
+		float const px = x[i] + step * u;
+		float const py = y[i] + step * v;
+
+		// close to a wall and moving towards it: reverse the corresponding coordinate (the direction stays unit)
+		bool const bounce_x = (px > boundary && u > 0) | (px < -boundary && u < 0);
+		bool const bounce_y = (py > boundary && v > 0) | (py < -boundary && v < 0);
+
+		x[i] = px;
+		y[i] = py;
+		dx[i] = bounce_x ? -u : u;
+		dy[i] = bounce_y ? -v : v;
+		dz[i] = w;
+	}
+}
+
+void light_swarm::follow_terrain(Terrain const& terrain, int begin, int end)
+{
+	if (end <= begin)
+		return;
+
+	// heights of the whole band in one batched query, then the offset (vectorized)
+	terrain.evaluate_terrain_height_points(&x[begin], &y[begin], &z[begin], end - begin);
+	for (int i = begin; i < end; i++)
+		z[i] += height;
+}
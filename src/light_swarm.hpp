@@ -0,0 +1,47 @@
+#pragma once
+
+#include "cgp/cgp.hpp"
+#include "terrain.hpp"
+#include "random.hpp"
+#include "parallel.hpp"
+
+/** The moving lights, hovering at a constant height above the terrain.
+Every update, the direction of each light turns slightly towards a random direction (inertia), then the light moves at constant speed,
+bounces on the walls of [-boundary, boundary]^2 (the coordinate of the direction is reversed), and follows the terrain.
+The state is stored as a structure of arrays and updated in bands on n_threads persistent threads (see worker_pool), in passes the compiler
+can vectorize (random directions, then motion and walls), and the heights of a band come from one batched query (evaluate_terrain_height_points).
+The random draws are indexed (see random_stream): the direction of light i at update k only depends on (stream, i, k),
+so the lights are identical whatever the number of threads.	*/
+struct light_swarm
+{
+	int n_threads = 0;				// threads used by update (0 = all the hardware threads)
+	int min_lights_per_thread = 2048;	// below, the update runs on fewer threads (waking threads costs more than moving a few lights)
+
+	random_stream random;			// stream of the positions and directions
+	float speed = 3.0f;				// distance covered per second
+	float inertia = 0.95f;			// weight of the previous direction (the rest is a random direction)
+	float height = 3.0f;			// height above the terrain
+	float boundary = 45.0f;			// the lights stay in [-boundary, boundary]^2
+
+	// state (structure of arrays): positions and unit directions
+	std::vector<float> x, y, z;
+	std::vector<float> dx, dy, dz;
+	uint32_t update_count = 0;		// number of updates since initialize (counter of the random directions)
+
+	float last_update_time = 0.0f;	// duration of the last update (in milliseconds)
+
+	int size() const { return int(x.size()); }
+	cgp::vec3 position(int i) const { return {x[i], y[i], z[i]}; }
+
+	// n lights at random positions of [-boundary, boundary]^2 with random directions
+	void initialize(Terrain const& terrain, int n, float boundary, random_stream const& random);
+	void update(Terrain const& terrain, float dt);
+
+private:
+	std::vector<float> rx, ry, rz;	// random directions of the current update
+	worker_pool workers;			// threads of update (started by the first update on more than one thread)
+
+	void random_directions(int begin, int end);
+	void move(int begin, int end, float dt);
+	void follow_terrain(Terrain const& terrain, int begin, int end);
+};
@@ -4,10 +4,14 @@
 #include <iostream> 
 
 #include <chrono>
+#include <cstdlib>
+#include <cstring>
 #include <thread>
 
 // Custom scene of this code
 #include "scene.hpp"
+#include "frame_pacer.hpp"
+#include "render_benchmark.hpp"
 
 
 
@@ -30,11 +34,45 @@ void animation_loop();
 void display_gui_default();
 
 timer_fps fps_record;
+frame_pacer frame_pacing;
+render_benchmark benchmark;
 
-int main(int, char* argv[])
+int main(int argc, char* argv[])
 {
 	std::cout << "Run " << argv[0] << std::endl;
 
+	// Options: --seed <n> replays the world generated from the seed n (a new seed is chosen otherwise)
+	//   --benchmark draws a scripted sequence offscreen and reports the frame times (see render_benchmark.hpp),
+	//   with --frames <n> measured frames and --lights <n> lights (the seed is 1 unless given)
+	scene.seed = uint64_t(std::chrono::system_clock::now().time_since_epoch().count());
+	bool seed_given = false;
+	for (int i = 1; i < argc; i++)
+	{
+		if (std::strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+		{
+			scene.seed = std::strtoull(argv[++i], nullptr, 10);
+			seed_given = true;
+		}
+		else if (std::strcmp(argv[i], "--benchmark") == 0)
+			benchmark.enabled = true;
+		else if (std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+			benchmark.n_frames = std::atoi(argv[++i]);
+		else if (std::strcmp(argv[i], "--lights") == 0 && i + 1 < argc)
+			scene.n_lights = std::atoi(argv[++i]);
+		else
+			std::cout << "Unknown option " << argv[i] << " (usage: " << argv[0] << " [--seed n] [--benchmark [--frames n] [--lights n]])" << std::endl;
+	}
+
+	if (benchmark.enabled)
+	{
+		if (!seed_given)
+			scene.seed = 1;
+		project::fps_limiting = false;
+		project::vsync = false;
+		project::initial_window_size_width = float(benchmark.width);
+		project::initial_window_size_height = float(benchmark.height);
+	}
+
 	
 
 	// ************************ //
@@ -54,7 +92,9 @@ int main(int, char* argv[])
 	// Custom scene initialization
 	std::cout << "Initialize data of the scene ..." << std::endl;
 	scene.initialize();
-	std::cout << "Initialization finished\n" << std::endl;
+	if (benchmark.enabled)
+		benchmark.initialize(scene);
+	std::cout << "Initialization finished (the assets are still loading in the background)\n" << std::endl;
 
 
 	// ************************ //
@@ -68,17 +108,24 @@ int main(int, char* argv[])
 	//  The following part is simply a loop that call the function "animation_loop"
 	//  (This call is different when we compile in standard mode with GLFW, than when we compile with emscripten to output the result in a webpage.)
 #ifndef __EMSCRIPTEN__
-    double lasttime = glfwGetTime();
 	// Default mode to run the animation/display loop with GLFW in C++
 	while (!glfwWindowShouldClose(scene.window.glfw_window)) {
+		// Offscreen benchmark: same loop, but the frames are scripted, drawn in the framebuffer of the benchmark and timed
+		if (benchmark.enabled)
+		{
+			benchmark.begin_frame(scene);
+			animation_loop();
+			benchmark.end_frame(scene);
+			if (benchmark.finished())
+				break;
+			continue;
+		}
+
 		// The real animation loop
 		animation_loop();
 
-		// FPS limitation
-		if(project::fps_limiting){
-			while (glfwGetTime() < lasttime + 1.0 / project::fps_max) {	}
-        	lasttime = glfwGetTime();
-		}
+		// FPS limitation (sleeps until the next frame deadline)
+		frame_pacing.end_frame(project::fps_limiting, project::fps_max);
 	}
 #else
 	// Specific loop if compiled for EMScripten
@@ -86,6 +133,11 @@ int main(int, char* argv[])
 #endif
 
 	std::cout << "\nAnimation loop stopped" << std::endl;
+	if (benchmark.enabled)
+	{
+		benchmark.report(scene);
+		benchmark.clear();
+	}
 
 	// Cleanup
 	cgp::imgui_cleanup();
@@ -97,6 +149,7 @@ int main(int, char* argv[])
 
 void animation_loop()
 {
+	scene.profiler.new_frame();
 
 	emscripten_update_window_size(scene.window.width, scene.window.height); // update window size in case of use of emscripten (not used by default)
 
@@ -135,8 +188,10 @@ void animation_loop()
 
 
 	// End of ImGui display and handle GLFW events
+	scene.profiler.begin(stage_imgui);
 	ImGui::End();
 	imgui_render_frame(scene.window.glfw_window);
+	scene.profiler.end();
 	glfwSwapBuffers(scene.window.glfw_window);
 	glfwPollEvents();
 }
@@ -148,9 +203,12 @@ void initialize_default_shaders()
 	//  By default, it should be "shaders/"
 	std::string default_path_shaders = project::path +"shaders/";
 
-	// Set standard mesh shader for mesh_drawable
-	mesh_drawable::default_shader.load(default_path_shaders +"mesh/mesh.vert.glsl", default_path_shaders +"mesh/mesh.frag.glsl");
-	triangles_drawable::default_shader.load(default_path_shaders +"mesh/mesh.vert.glsl", default_path_shaders +"mesh/mesh.frag.glsl");
+	// The programs are restored from their binary when they were already linked by a previous launch (see program_cache.hpp)
+	scene.programs.directory = project::path + "cache/shaders/";
+
+	// Set standard mesh shader for mesh_drawable (the same program for triangles_drawable)
+	scene.programs.load(mesh_drawable::default_shader, default_path_shaders +"mesh/mesh.vert.glsl", default_path_shaders +"mesh/mesh.frag.glsl");
+	triangles_drawable::default_shader = mesh_drawable::default_shader;
 
 	// Set default white texture
 	image_structure const white_image = image_structure{ 1,1,image_color_type::rgba,{255,255,255,255} };
@@ -158,7 +216,7 @@ void initialize_default_shaders()
 	triangles_drawable::default_texture.initialize_texture_2d_on_gpu(white_image);
 
 	// Set standard uniform color for curve/segment_drawable
-	curve_drawable::default_shader.load(default_path_shaders +"single_color/single_color.vert.glsl", default_path_shaders+"single_color/single_color.frag.glsl");
+	scene.programs.load(curve_drawable::default_shader, default_path_shaders +"single_color/single_color.vert.glsl", default_path_shaders+"single_color/single_color.frag.glsl");
 }
 
 
@@ -178,6 +236,10 @@ window_structure standard_window_initialization()
 	// First initialize GLFW
 	scene.window.initialize_glfw();
 
+	// the benchmark draws offscreen: its window is never shown
+	if (benchmark.enabled)
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
 	// Compute initial window width and height
 	int window_width = int(project::initial_window_size_width);
 	int window_height = int(project::initial_window_size_height);
@@ -189,6 +251,8 @@ window_structure standard_window_initialization()
 	// Create the window using GLFW
 	window_structure window;
 	window.create_window(window_width, window_height, "CGP Display", CGP_OPENGL_VERSION_MAJOR, CGP_OPENGL_VERSION_MINOR);
+	if (!project::vsync)
+		glfwSwapInterval(0);
 
 
 	// Display information
@@ -270,15 +334,27 @@ void keyboard_callback(GLFWwindow* window, int key, int scancode, int action, in
 			else
 				scene.window.set_windowed_screen();
 		}
-		if (key == GLFW_KEY_SPACE && action == GLFW_PRESS)
+		// the game keys wait for the end of the loading
+		bool const game_key = scene.level_ready && action == GLFW_PRESS;
+
+		if (key == GLFW_KEY_SPACE && game_key)
 			scene.space_pressed();
 
-		if (key == GLFW_KEY_T && action == GLFW_PRESS)
+		if (key == GLFW_KEY_T && game_key)
 			scene.reset_position();
 
-		if (key == GLFW_KEY_P && action == GLFW_PRESS)
+		if (key == GLFW_KEY_P && game_key)
 			scene.reset_target_position();
 
+		if (key == GLFW_KEY_N && game_key)
+			scene.new_level();
+
+		if (key == GLFW_KEY_B && game_key)
+			scene.sculpt();
+
+		if (key == GLFW_KEY_H && game_key)
+			scene.aim_assist();
+
 		// Press 'V' for camera frame/view matrix debug
 		if (key == GLFW_KEY_V && action == GLFW_PRESS && scene.inputs.keyboard.shift) {
 			auto const camera_model = scene.camera_control.camera_model;
@@ -321,6 +397,10 @@ void display_gui_default()
 		if(project::fps_limiting){
 			ImGui::SliderFloat("FPS limit",&project::fps_max, 10, 250);
 		}
+		std::string frame_time = "Frame time " + str(float(1000 * frame_pacing.mean_frame_time)) + " ms (jitter " + str(float(1000 * frame_pacing.jitter)) + " ms)";
+		ImGui::Text( frame_time.c_str(), "%s" );
+		std::string missed = "Missed deadlines: " + str(int(frame_pacing.missed_deadlines));
+		ImGui::Text( missed.c_str(), "%s" );
 #endif
 		// vsync is the default synchronization of frame refresh with the screen frequency
 		//   vsync may or may not be enforced by your GPU driver and OS (on top of the GLFW request).
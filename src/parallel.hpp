@@ -0,0 +1,118 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Number of threads to use: n_threads if > 0, otherwise the number of hardware threads
+inline int parallel_thread_count(int n_threads)
+{
+	if (n_threads > 0)
+		return n_threads;
+	return std::max(1, int(std::thread::hardware_concurrency()));
+}
+
+// Split [0, n) into (at most) n_threads contiguous bands and call f(begin, end) on each band.
+// The bands are processed in parallel (the calling thread handles the first one), and the function returns when all of them are done.
+// The bands only depend on n and n_threads, so f must not depend on the order in which they are processed.
+template <typename F>
+void parallel_for_bands(int n, int n_threads, F const& f)
+{
+	int const n_bands = std::max(1, std::min(parallel_thread_count(n_threads), n));
+
+	std::vector<std::thread> threads;
+	threads.reserve(n_bands - 1);
+
+	for (int b = 1; b < n_bands; b++)
+		threads.emplace_back([&f, b, n, n_bands]() { f(b * n / n_bands, (b + 1) * n / n_bands); });
+
+	f(0, n / n_bands);
+
+	for (std::thread& t : threads)
+		t.join();
+}
+
+// Persistent threads for the loops repeated every frame: same bands as parallel_for_bands, but the workers are started by the first
+// call and then wait for the next one, so a loop costs a wake-up instead of the creation of its threads.
+// The calls must come from one thread at a time (the calling thread handles the first band, as in parallel_for_bands).
+class worker_pool
+{
+public:
+	worker_pool() = default;
+	worker_pool(worker_pool const&) = delete;
+	worker_pool& operator=(worker_pool const&) = delete;
+
+	~worker_pool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (std::thread& t : workers)
+			t.join();
+	}
+
+	template <typename F>
+	void for_bands(int n, int n_threads, F const& f)
+	{
+		int const n_bands = std::max(1, std::min(parallel_thread_count(n_threads), n));
+		if (n_bands == 1)
+		{
+			f(0, n);
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			while (int(workers.size()) < n_bands - 1)
+				workers.emplace_back([this]() { work(); });
+
+			task = [&f](int begin, int end) { f(begin, end); };
+			task_n = n;
+			task_bands = n_bands;
+			next_band = 1;
+			remaining = n_bands - 1;
+		}
+		wake.notify_all();
+
+		f(0, n / n_bands);
+
+		std::unique_lock<std::mutex> lock(mutex);
+		done.wait(lock, [this]() { return remaining == 0; });
+		task = nullptr;
+	}
+
+private:
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wake, done;
+
+	// current loop: the bands [next_band, task_bands) are not taken yet, remaining are not finished
+	std::function<void(int, int)> task;
+	int task_n = 0, task_bands = 0, next_band = 0, remaining = 0;
+	bool stopping = false;
+
+	void work()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true)
+		{
+			wake.wait(lock, [this]() { return stopping || next_band < task_bands; });
+			if (stopping)
+				return;
+
+			int const b = next_band++;
+			int const begin = b * task_n / task_bands, end = (b + 1) * task_n / task_bands;
+			lock.unlock();
+			task(begin, end);
+			lock.lock();
+
+			if (--remaining == 0)
+				done.notify_one();
+		}
+	}
+};
@@ -0,0 +1,192 @@
+#include "program_cache.hpp"
+#include "file_system.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+using namespace cgp;
+
+namespace
+{
+	uint64_t fnv1a(std::string const& s)
+	{
+		uint64_t hash = 14695981039346656037ull;
+		for (unsigned char c : s)
+			hash = (hash ^ c) * 1099511628211ull;
+		return hash;
+	}
+
+	std::string gl_string(GLenum name)
+	{
+		char const* s = reinterpret_cast<char const*>(glGetString(name));
+		return s == nullptr ? "" : s;
+	}
+
+	GLuint compile_shader(GLenum type, std::string const& source, std::string const& path)
+	{
+		char const* source_ptr = source.c_str();
+		GLuint shader = glCreateShader(type);
+		glShaderSource(shader, 1, &source_ptr, nullptr);
+		glCompileShader(shader);
+
+		GLint success = 0;
+		glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+		if (!success)
+		{
+			char log[1024];
+			glGetShaderInfoLog(shader, 1024, nullptr, log);
+			std::cerr << "Error: cannot compile " << path << "\n" << log << std::endl;
+		}
+		return shader;
+	}
+
+	char const magic[8] = {'L', 'B', 'M', 'P', 'R', 'O', 'G', '1'};
+}
+
+void program_cache::load(opengl_shader_structure& shader, std::string const& vertex_shader_path, std::string const& fragment_shader_path)
+{
+	auto const t0 = std::chrono::steady_clock::now();
+
+	std::string const vertex_source = read_text_file(vertex_shader_path);
+	std::string const fragment_source = read_text_file(fragment_shader_path);
+
+#ifndef __EMSCRIPTEN__
+	GLint n_formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &n_formats);
+	bool const use_cache = enabled && n_formats > 0;
+
+	// everything the binary depends on
+	char source_hash[17];
+	std::snprintf(source_hash, sizeof(source_hash), "%016llx", (unsigned long long)fnv1a(vertex_source + '\0' + fragment_source));
+	std::string const key = std::string(source_hash) + "\n" + gl_string(GL_VENDOR) + "\n" + gl_string(GL_RENDERER) + "\n" + gl_string(GL_VERSION)
+		+ "\ncgp " + std::to_string(CGP_OPENGL_VERSION_MAJOR) + "." + std::to_string(CGP_OPENGL_VERSION_MINOR) + "\nformat " + std::to_string(version);
+	char name[32];
+	std::snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)fnv1a(key));
+	std::string const path = directory + name;
+
+	GLuint program = use_cache ? restore(path, key) : 0;
+	if (program != 0)
+		n_restored++;
+	else
+#else
+	GLuint program = 0;
+#endif
+	{
+		GLuint const vertex_shader = compile_shader(GL_VERTEX_SHADER, vertex_source, vertex_shader_path);
+		GLuint const fragment_shader = compile_shader(GL_FRAGMENT_SHADER, fragment_source, fragment_shader_path);
+
+		program = glCreateProgram();
+		glAttachShader(program, vertex_shader);
+		glAttachShader(program, fragment_shader);
+#ifndef __EMSCRIPTEN__
+		// only with the cache: without GL 4.1 or ARB_get_program_binary, the entry point is null
+		if (use_cache)
+			glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+#endif
+		glLinkProgram(program);
+
+		GLint success = 0;
+		glGetProgramiv(program, GL_LINK_STATUS, &success);
+		if (!success)
+		{
+			char log[1024];
+			glGetProgramInfoLog(program, 1024, nullptr, log);
+			std::cerr << "Error: cannot link " << vertex_shader_path << " and " << fragment_shader_path << "\n" << log << std::endl;
+		}
+
+		glDetachShader(program, vertex_shader);
+		glDetachShader(program, fragment_shader);
+		glDeleteShader(vertex_shader);
+		glDeleteShader(fragment_shader);
+		n_compiled++;
+
+#ifndef __EMSCRIPTEN__
+		if (use_cache && success)
+			save(program, path, key);
+#endif
+	}
+
+	shader.id = program;
+	total_time += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+}
+
+#ifndef __EMSCRIPTEN__
+
+// Layout of a file: magic, key length, key, binary format, binary length, binary
+GLuint program_cache::restore(std::string const& path, std::string const& key) const
+{
+	FILE* f = std::fopen(path.c_str(), "rb");
+	if (f == nullptr)
+		return 0;
+
+	char file_magic[8];
+	uint32_t key_length = 0, format = 0, length = 0;
+	std::string file_key;
+	std::vector<char> binary;
+
+	bool ok = std::fread(file_magic, 1, 8, f) == 8 && std::memcmp(file_magic, magic, 8) == 0
+		&& std::fread(&key_length, sizeof(key_length), 1, f) == 1 && key_length == key.size();
+	if (ok)
+	{
+		file_key.resize(key_length);
+		ok = std::fread(&file_key[0], 1, key_length, f) == key_length && file_key == key
+			&& std::fread(&format, sizeof(format), 1, f) == 1 && std::fread(&length, sizeof(length), 1, f) == 1 && length > 0;
+	}
+	if (ok)
+	{
+		binary.resize(length);
+		ok = std::fread(binary.data(), 1, length, f) == length;
+	}
+	std::fclose(f);
+	if (!ok)
+		return 0;
+
+	GLuint program = glCreateProgram();
+	glProgramBinary(program, format, binary.data(), GLsizei(length));
+
+	GLint success = 0;
+	glGetProgramiv(program, GL_LINK_STATUS, &success);
+	if (!success)
+	{
+		glDeleteProgram(program);
+		return 0;
+	}
+	return program;
+}
+
+void program_cache::save(GLuint program, std::string const& path, std::string const& key) const
+{
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return;
+
+	std::vector<char> binary(length);
+	GLenum format = 0;
+	glGetProgramBinary(program, length, &length, &format, binary.data());
+	if (length <= 0)
+		return;
+
+	create_directories(directory);
+
+	// written to a temporary file, then renamed: a reader never sees a partial file
+	std::string const temporary = path + ".tmp";
+	FILE* f = std::fopen(temporary.c_str(), "wb");
+	if (f == nullptr)
+		return;
+
+	uint32_t const key_length = uint32_t(key.size()), format_u = uint32_t(format), length_u = uint32_t(length);
+	bool ok = std::fwrite(magic, 1, 8, f) == 8 && std::fwrite(&key_length, sizeof(key_length), 1, f) == 1
+		&& std::fwrite(key.data(), 1, key.size(), f) == key.size()
+		&& std::fwrite(&format_u, sizeof(format_u), 1, f) == 1 && std::fwrite(&length_u, sizeof(length_u), 1, f) == 1
+		&& std::fwrite(binary.data(), 1, length_u, f) == length_u;
+	ok = std::fclose(f) == 0 && ok;
+	ok = ok && replace_file(temporary, path);
+	if (!ok)
+		std::remove(temporary.c_str());
+}
+
+#endif
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "cgp/cgp.hpp"
+
+#include <string>
+
+/** Cache of the linked shader programs, in directory (one file per program).
+load compiles and links a program from its GLSL sources the first time, then saves the binary returned by glGetProgramBinary.
+The next launches restore it with glProgramBinary, which skips the compilation and the link.
+A file is keyed by a hash of the two sources, the vendor/renderer/version strings of the driver, the OpenGL version requested by cgp
+(CGP_OPENGL_VERSION_*) and program_cache::version. The whole key is stored in the file and compared when loading.
+When the binary is rejected (e.g. the driver changed without changing its strings), the program is compiled again and the file replaced.
+Without program binaries (no binary format, or emscripten), load only compiles.	*/
+struct program_cache
+{
+	static uint32_t const version = 1;
+
+	std::string directory = "cache/shaders/";
+	bool enabled = true;
+
+	// statistics since the start
+	int n_restored = 0;			// programs restored from their binary
+	int n_compiled = 0;			// programs compiled from their sources
+	double total_time = 0;		// time spent in load (in milliseconds)
+
+	// set shader.id to the program made of the two shaders (restored from the cache if possible)
+	void load(cgp::opengl_shader_structure& shader, std::string const& vertex_shader_path, std::string const& fragment_shader_path);
+
+private:
+	GLuint restore(std::string const& path, std::string const& key) const;
+	void save(GLuint program, std::string const& path, std::string const& key) const;
+};
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+/** Counter-based random numbers: Philox4x32-10 (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3", SC 2011).
+The output is a pure function of a 128-bit counter and a 64-bit key, so there is no generator state to share between threads:
+the i-th draw of an element can be computed directly from (key, element index, draw index), in any order and on any thread.	*/
+inline std::array<uint32_t, 4> philox4x32(std::array<uint32_t, 4> counter, std::array<uint32_t, 2> key)
+{
+	uint32_t const M0 = 0xD2511F53u, M1 = 0xCD9E8D57u;		// round multipliers
+	uint32_t const W0 = 0x9E3779B9u, W1 = 0xBB67AE85u;		// key schedule (golden ratio, sqrt(3) - 1)
+
+	for (int round = 0; round < 10; round++)
+	{
+		uint64_t const p0 = uint64_t(M0) * counter[0];
+		uint64_t const p1 = uint64_t(M1) * counter[2];
+		counter = {uint32_t(p1 >> 32) ^ counter[1] ^ key[0], uint32_t(p1), uint32_t(p0 >> 32) ^ counter[3] ^ key[1], uint32_t(p0)};
+		key = {key[0] + W0, key[1] + W1};
+	}
+	return counter;
+}
+
+// Uniform float in [0, 1) from the 24 high bits of x
+inline float random_unit_float(uint32_t x)
+{
+	return float(x >> 8) * (1.0f / 16777216.0f);
+}
+
+// Uniform float in [a, b) from the bits x
+inline float random_float(uint32_t x, float a, float b)
+{
+	return a + (b - a) * random_unit_float(x);
+}
+
+/** Seedable, splittable random stream built on philox4x32.
+A stream is a key: random_stream(seed) derives it from a 64-bit seed, and split(id) derives the key of an independent child stream
+(the same seed and ids always give the same streams, whatever the order in which they are created). The draws are either
+	- indexed: bits(i, j, k) only depends on the key and (i, j, k), so the elements of a generation can be drawn on any thread, in any order,
+	- sequential: next/uniform walk a counter of the stream, for the draws that happen one after the other (e.g. the placements of the ball).	*/
+struct random_stream
+{
+	std::array<uint32_t, 2> key = {0, 0};
+	uint64_t counter = 0;				// number of sequential draws
+
+	random_stream() {}
+	explicit random_stream(uint64_t seed) : key{{uint32_t(seed), uint32_t(seed >> 32)}} {}
+
+	random_stream split(uint32_t id) const
+	{
+		std::array<uint32_t, 4> const r = philox4x32({id, 0, 0, domain_split}, key);
+		random_stream child;
+		child.key = {r[0], r[1]};
+		return child;
+	}
+
+	std::array<uint32_t, 4> bits(uint32_t i, uint32_t j = 0, uint32_t k = 0) const
+	{
+		return philox4x32({i, j, k, domain_indexed}, key);
+	}
+
+	uint32_t next()
+	{
+		uint64_t const c = counter++;
+		return philox4x32({uint32_t(c), uint32_t(c >> 32), 0, domain_sequential}, key)[0];
+	}
+	float uniform() { return random_unit_float(next()); }
+	float uniform(float a, float b) { return random_float(next(), a, b); }
+
+private:
+	// the last word of the counter separates the three kinds of draws
+	enum : uint32_t { domain_indexed = 0, domain_sequential = 1, domain_split = 2 };
+};
+
+// Streams of the world generation (children of the stream of the seed)
+enum random_stream_id : uint32_t
+{
+	random_terrain = 1,		// bumps (split again by level)
+	random_lights = 2,		// colors, positions and motion of the lights
+	random_placement = 3,	// positions of the ball and the target
+	random_benchmark = 4	// kicks of the render benchmark (see render_benchmark.hpp)
+};
@@ -0,0 +1,144 @@
+#include "render_benchmark.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+
+using namespace cgp;
+
+void render_benchmark::initialize(scene_structure& scene)
+{
+	// color and depth buffers: the window is hidden, so its own framebuffer may not be drawn at all
+	glGenRenderbuffers(1, &color_buffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, color_buffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	glGenRenderbuffers(1, &depth_buffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, depth_buffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color_buffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth_buffer);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		std::cerr << "Error: the framebuffer of the benchmark is incomplete" << std::endl;
+
+	scene.fixed_time_step = 1.0f / 60.0f;
+	scene.reachability_check = false;		// the search runs on other threads, for a variable time: it would make the frame times depend on the machine load
+	scene.profiler.history = n_frames;		// the statistics of the profiler cover the measured frames
+	scene.profiler.initialize(profiler_stage_names);
+
+	kicks = random_stream(scene.seed).split(random_benchmark);
+	frame = 0;
+	stopped_frames = 0;
+	frame_times.clear();
+	frame_times.reserve(n_frames);
+	drawn_tiles.clear();
+	drawn_vertices.clear();
+	built_tiles = evicted_tiles = 0;
+}
+
+void render_benchmark::begin_frame(scene_structure& scene)
+{
+	// the viewport and the projection of the frame follow the size of the framebuffer, whatever the size given to the hidden window
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	scene.window.width = width;
+	scene.window.height = height;
+	frame_start = clock::now();
+	if (!scene.level_ready)
+		return;
+
+	// camera: a turn around the arena, looking at the opposite side of an inner circle, with a slow change of height
+	float const L = scene.terrain_length;
+	float const t = scene.timer.t;
+	float const angle = 2 * Pi * t / flight_period;
+	vec3 eye = {0.4f * L * std::cos(angle), 0.4f * L * std::sin(angle), 0};
+	eye.z = scene.terrain.get_height(eye.x, eye.y) + 12 + 6 * std::sin(3 * angle);
+	vec3 const center = {0.15f * L * std::cos(angle + Pi / 2), 0.15f * L * std::sin(angle + Pi / 2), 0};
+	scene.camera_control.look_at(eye, center, {0, 0, 1});
+
+	// kicks: once the ball stops, draw a kick (shown by the arrow and the parabola), then launch it aim_frames later
+	if (scene.phase == 0)
+		stopped_frames = 0;
+	else if (stopped_frames++ == 0)
+	{
+		scene.angle_phi = kicks.uniform(0, 2 * Pi);
+		scene.angle_theta = kicks.uniform(Pi / 6, Pi / 3);
+		scene.force_strength = kicks.uniform(0.3f, 1.7f);
+		scene.phase = 4;
+	}
+	else if (stopped_frames > aim_frames)
+		scene.space_pressed();
+}
+
+void render_benchmark::end_frame(scene_structure& scene)
+{
+	glFinish();
+	if (!scene.level_ready)
+		return;
+
+	if (frame++ >= warmup_frames && !finished())
+	{
+		frame_times.push_back(std::chrono::duration<double, std::milli>(clock::now() - frame_start).count());
+
+		terrain_tiles_drawable const& tiles = scene.terrain_tiles;
+		drawn_tiles.push_back(tiles.drawn_tiles);
+		drawn_vertices.push_back(tiles.drawn_vertices);
+		built_tiles += tiles.built_tiles;
+		evicted_tiles += tiles.evicted_tiles;
+	}
+}
+
+void render_benchmark::report(scene_structure const& scene) const
+{
+	std::vector<double> sorted = frame_times;
+	std::sort(sorted.begin(), sorted.end());
+	if (sorted.empty())
+		return;
+
+	double sum = 0;
+	for (double t : sorted)
+		sum += t;
+	double const mean = sum / sorted.size();
+
+	// nearest-rank percentiles
+	auto percentile = [&](double p) { return sorted[std::max(0, int(std::ceil(p / 100 * sorted.size())) - 1)]; };
+
+	std::printf("\nRender benchmark: %d frames of %dx%d, seed %llu, %d lights, %d terrain samples\n",
+		int(sorted.size()), width, height, (unsigned long long)scene.seed, scene.n_lights, scene.N_terrain_samples);
+	std::printf("  frame time: mean %.3f ms (%.1f fps), p50 %.3f ms, p90 %.3f ms, p95 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+		mean, 1000 / mean, percentile(50), percentile(90), percentile(95), percentile(99), sorted.back());
+
+	std::printf("  %-20s %17s %17s\n", "stage", "CPU avg / p99", "GPU avg / p99");
+	for (int i = 0; i < int(profiler_stage_names.size()); i++)
+	{
+		profiler_statistics const cpu = scene.profiler.cpu_statistics(i);
+		profiler_statistics const gpu = scene.profiler.gpu_statistics(i);
+		std::printf("  %-20s %7.3f / %7.3f %7.3f / %7.3f  (%d frames)\n", profiler_stage_names[i].c_str(), cpu.average, cpu.p99, gpu.average, gpu.p99, cpu.n_samples);
+	}
+
+	if (scene.terrain_tiled && !drawn_tiles.empty())
+	{
+		double tiles_sum = 0, vertices_sum = 0;
+		for (size_t k = 0; k < drawn_tiles.size(); k++)
+		{
+			tiles_sum += drawn_tiles[k];
+			vertices_sum += drawn_vertices[k];
+		}
+		std::printf("  terrain tiles: drawn mean %.1f / max %d, vertices mean %.0f / max %d, %ld built and %ld evicted (%d levels of %dx%d tiles at the finest)\n",
+			tiles_sum / drawn_tiles.size(), *std::max_element(drawn_tiles.begin(), drawn_tiles.end()),
+			vertices_sum / drawn_vertices.size(), *std::max_element(drawn_vertices.begin(), drawn_vertices.end()),
+			built_tiles, evicted_tiles, scene.terrain_tiles.n_lods, scene.terrain_tiles.n_tiles, scene.terrain_tiles.n_tiles);
+	}
+	std::fflush(stdout);
+}
+
+void render_benchmark::clear()
+{
+	glDeleteFramebuffers(1, &framebuffer);
+	glDeleteRenderbuffers(1, &color_buffer);
+	glDeleteRenderbuffers(1, &depth_buffer);
+	framebuffer = color_buffer = depth_buffer = 0;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "scene.hpp"
+
+#include <chrono>
+#include <vector>
+
+/** Deterministic render benchmark (option --benchmark).
+The frames are drawn in an offscreen framebuffer of width*height pixels (the window is hidden), without fps limiting nor vsync,
+and the time advances by a fixed step of 1/60 s per frame: with the same seed and number of lights, every run draws the same frames.
+The camera flies along a scripted path around the arena, and the ball is kicked (with kicks drawn from the seed) aim_frames after it stops.
+The timing starts once the assets are loaded, skips warmup_frames, then measures n_frames; each frame ends with glFinish,
+so its time includes the rendering. The percentiles of the frame times and the profiler stages are printed at the end,
+as well as the drawn tiles and vertices, builds and evictions of the terrain tiles when the terrain is tiled.
+On a Linux machine without display nor GPU, run it with Mesa's software rasterizer in a virtual X server:
+	LIBGL_ALWAYS_SOFTWARE=1 xvfb-run -a ./project --benchmark	*/
+struct render_benchmark
+{
+	bool enabled = false;
+	int width = 1280;
+	int height = 720;
+	int n_frames = 600;				// measured frames
+	int warmup_frames = 60;			// frames drawn before the measure
+	int aim_frames = 60;			// frames between the stop of the ball and the next kick (the arrow and the parabola are drawn meanwhile)
+	float flight_period = 20.0f;	// duration of one turn of the camera around the arena (in seconds of scene time)
+
+	void initialize(scene_structure& scene);	// after scene.initialize: framebuffer, fixed time step, profiler history
+	void begin_frame(scene_structure& scene);	// before the frame: camera and kicks, binds the framebuffer
+	void end_frame(scene_structure& scene);		// after the frame: waits for the GPU and records the frame time
+	bool finished() const { return int(frame_times.size()) == n_frames; }
+	void report(scene_structure const& scene) const;
+	void clear();
+
+private:
+	using clock = std::chrono::steady_clock;
+
+	GLuint framebuffer = 0, color_buffer = 0, depth_buffer = 0;
+	random_stream kicks;
+	int frame = 0;						// frames since the level is ready
+	int stopped_frames = 0;				// frames since the ball stopped
+	clock::time_point frame_start;
+	std::vector<double> frame_times;	// measured frames (in milliseconds)
+
+	// statistics of the terrain tiles over the measured frames (with terrain_tiled)
+	std::vector<int> drawn_tiles, drawn_vertices;
+	long built_tiles = 0, evicted_tiles = 0;
+};
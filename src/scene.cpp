@@ -1,23 +1,14 @@
 #include "scene.hpp"
 #include "terrain.hpp"
+#include "parallel.hpp"
 
 using namespace cgp;
 
-cgp::vec3 get_random_color()
+// color of the i-th light
+cgp::vec3 get_random_color(random_stream const& random, int i)
 {
-	return {rand_uniform(0.3, 1.0), rand_uniform(0.3, 1.0), rand_uniform(0.3, 1.0)};
-}
-
-cgp::vec3 get_random_normalized()
-{
-	return cgp::normalize(cgp::vec3{cgp::rand_uniform(-1., 1.), cgp::rand_uniform(-1., 1.), cgp::rand_uniform(-1., 1.)});
-}
-
-cgp::vec3 scene_structure::reflect(cgp::vec3 v, cgp::vec3 n)
-{
-	cgp::vec3 new_v;
-	new_v = 2 * n * dot(n, v) - v;
-	return -new_v;
+	std::array<uint32_t, 4> const r = random.bits(i);
+	return {random_float(r[0], 0.3f, 1.0f), random_float(r[1], 0.3f, 1.0f), random_float(r[2], 0.3f, 1.0f)};
 }
 
 void scene_structure::initialize()
@@ -25,94 +16,118 @@ void scene_structure::initialize()
 	// General information
 	display_info();
 
-	// change the random seed
-	srand(time(NULL));
-	cgp::rand_initialize_generator();
+	// streams of the world (the same seed gives the same levels, lights and placements)
+	std::cout << "Seed: " << seed << " (use --seed " << seed << " to replay this game)\n" << std::endl;
+	world_random = random_stream(seed);
+	placement_random = world_random.split(random_placement);
+	level = 0;
+
+	// intialize terrain
+
+	terrain.cache_resolution = height_cache_resolution;
+	terrain.n_threads = terrain_build_threads;
+#ifdef __EMSCRIPTEN__
+	terrain_gpu_generation = false;
+#endif
+	terrain.build_mesh = !terrain_tiled && !terrain_gpu_generation;
+	terrain.random = world_random.split(random_terrain).split(level);
+	level_files.directory = project::path + "cache/";
+
+	camera_control.initialize(inputs, window); // Give access to the inputs and window global state to the camera controler
+	camera_control.translation_speed *= 10;
+
+	// the terrain and the skybox are prepared on worker threads during the rest of the initialization and the first frames (see display_frame),
+	// then sent to the GPU by this thread; the level starts once they are both ready
+
+	assets.add("terrain",
+		[this]() { level_cached = level_files.create_terrain(terrain, N_terrain_samples, terrain_length, n_bumps); },
+		[this]() { initialize_terrain_on_gpu(); initialize_level(); });
+
+	// the skybox is read from its cooked file when it exists, and decoded from the JPEG otherwise (then cooked for the next launches)
+	std::string const skybox_path = project::path + "assets/skybox.jpg";
+	std::string const skybox_cooked_path = project::path + "cache/skybox.cubemap";
+
+	assets.add("skybox",
+		[this, skybox_path, skybox_cooked_path]() {
+#ifndef __EMSCRIPTEN__
+			if (skybox_cooked.read(skybox_cooked_path, skybox_path))
+				return;
+#endif
+			// (code from the cgp examples)
+			image_structure image_skybox_template = image_load_file(skybox_path);
+			skybox_faces = image_split_grid(image_skybox_template, 4, 3);
+		},
+		[this, skybox_path, skybox_cooked_path]() {
+			skybox.initialize_data_on_gpu();
+			skybox.model.rotation = cgp::rotation_axis_angle({1,0,0}, Pi/2);
+
+			if (!skybox_cooked.texels.empty())
+			{
+				// cgp creates the cubemap texture (with placeholder faces), then all its faces and levels are replaced
+				image_structure const texel = image_structure{ 1,1,image_color_type::rgba,{0,0,0,255} };
+				skybox.texture.initialize_cubemap_on_gpu(texel, texel, texel, texel, texel, texel);
+				skybox_cooked.upload(skybox.texture.id);
+				std::cout << "Skybox read from " << skybox_cooked_path << " (" << skybox_cooked.n_levels << " levels)" << std::endl;
+				skybox_cooked = cooked_cubemap();
+				return;
+			}
+
+			skybox.texture.initialize_cubemap_on_gpu(skybox_faces[1], skybox_faces[7], skybox_faces[5], skybox_faces[3], skybox_faces[10], skybox_faces[4]);
+			skybox_faces.clear();
+#ifndef __EMSCRIPTEN__
+			if (skybox_cooked.cook(skybox.texture.id, skybox_cooked_path, skybox_path))
+				std::cout << "Skybox cooked in " << skybox_cooked_path << std::endl;
+			skybox_cooked = cooked_cubemap();
+#endif
+		});
+
+	assets.start();
 
 	global_frame.initialize_data_on_gpu(mesh_primitive_frame());
 
 	// load shaders
 
-	shader_custom.load(
+	programs.load(shader_custom,
 		project::path + "shaders/shading_custom/shading_custom.vert.glsl",
 		project::path + "shaders/shading_custom/shading_custom.frag.glsl");
 
-	shader_parabola.load(
+	programs.load(shader_parabola,
 		project::path + "shaders/shading_parabola/shading_parabola.vert.glsl",
 		project::path + "shaders/shading_parabola/shading_parabola.frag.glsl"
 	);
 
-	// intialize terrain
+	programs.load(shader_instanced_sphere,
+		project::path + "shaders/instanced_sphere/instanced_sphere.vert.glsl",
+		project::path + "shaders/instanced_sphere/instanced_sphere.frag.glsl");
+	std::cout << "Shader programs: " << programs.n_restored << " restored from " << programs.directory << ", " << programs.n_compiled << " compiled, in " << programs.total_time << " ms" << std::endl;
 
-	terrain.create_terrain_mesh(N_terrain_samples, terrain_length, n_bumps);
+	profiler.initialize(profiler_stage_names);
 
-	terrain_mesh.initialize_data_on_gpu(terrain.mesh);
-	terrain_mesh.shader = shader_custom;
-	terrain_mesh.material.color = {1, 1, 1};
+	// per-frame data of shading_custom and instanced_sphere (camera, lighting parameters and light clusters)
+	environment.initialize_frame_uniform_buffer();
+	environment.attach_frame_uniform_buffer(shader_custom.id);
+	environment.attach_frame_uniform_buffer(shader_instanced_sphere.id);
+	lights_gpu.initialize(terrain_length, light_cluster_resolution);
+	lights_gpu.attach(shader_custom.id, 1);
 
-	// initialize the camera
+	// the shot search leaves one core to the rendering
+	solver.n_threads = std::max(1, parallel_thread_count(0) - 1);
 
-	camera_control.initialize(inputs, window); // Give access to the inputs and window global state to the camera controler
-	camera_control.translation_speed *= 10;
-	camera_control.camera_model.position_camera = {-10, -10, terrain.evaluate_terrain_height(-10,-10) + 10};
-
-	// initialize the position & speed of the ball (this also moves the camera to look at the ball)
-	
-	reset_position();
-
-	// initialize light meshes, positions, speeds and colors
-	// (n_lights moving lights, one inside the ball, one above the target)
-
-	spheres.resize(n_lights+2);
-	light_colors.resize(n_lights+2);
-	light_pos.resize(n_lights);
-	light_speed.resize(n_lights);
-
-	for (int i = 0; i < n_lights; i++)
-	{
-		light_colors[i] = get_random_color();
-
-		// avoid spawning lights too close to the walls and spawn them slightly above ground
-		light_pos[i] = {cgp::rand_uniform(-terrain_length / 2.2, terrain_length / 2.2), cgp::rand_uniform(-terrain_length / 2.2, terrain_length / 2.2), 0};
-		light_pos[i].z = terrain.evaluate_terrain_height(light_pos[i].x, light_pos[i].y) + 3.0f;
-
-		light_speed[i] = get_random_normalized();
-		
-		mesh sphere_mesh = mesh_primitive_sphere();
-		spheres[i].initialize_data_on_gpu(sphere_mesh);
-		spheres[i].model.scaling = 0.5f;
-		spheres[i].material.color = light_colors[i];
-		// spheres[i].shader = shader_custom;
-	}
-
-	// initialize the position of the light inside the ball, and the light above the target
-	// (they're special lights so they aren't included in n_lights)
-
-	// red light of the ball
-	light_colors[n_lights] = {1.0f, 0, 0};
-	mesh sphere_mesh1 = mesh_primitive_sphere();
-	spheres[n_lights].initialize_data_on_gpu(sphere_mesh1);
-	spheres[n_lights].model.scaling = 0.2f;
-	spheres[n_lights].material.color = light_colors[n_lights];
-
-	// blue light above the target	
-	light_colors[n_lights+1] = {0, 0, 1.0f};
-	mesh sphere_mesh2 = mesh_primitive_sphere();
-	spheres[n_lights+1].initialize_data_on_gpu(sphere_mesh2);
-	spheres[n_lights+1].model.scaling = 0.2f; // coordinates are multiplied by 0.2 in the shader
-	spheres[n_lights+1].material.color = light_colors[n_lights+1];
+	// all the spheres share one mesh, drawn in a single instanced call
+	spheres.initialize_data_on_gpu(mesh_primitive_sphere(), shader_instanced_sphere);
 
 	// initialize the ball mesh
 
 	mesh ball_mesh = mesh_primitive_sphere();
 	ball.initialize_data_on_gpu(ball_mesh);
-	ball.model.scaling = ball_radius;
+	ball.model.scaling = physics.parameters.ball_radius;
 	// ball.texture.load_and_initialize_texture_2d_on_gpu(project::path + "assets/tex.jpeg");
 	// since the ball doesn't roll, the texture was fixed and didn't look nice
 	ball.material.color = {1,0,0};
 
 	// initialize the target mesh
 
+	physics.parameters.target_radius = torus_max_radius;
 	mesh torus_mesh = mesh_primitive_torus(torus_max_radius, torus_min_radius);
 	target.initialize_data_on_gpu(torus_mesh);
 	target.material.color = {0., 0., 9.};
@@ -122,8 +137,6 @@ void scene_structure::initialize()
 	rotation_transform R = rotation_transform::from_axis_angle({ 1,0,0 }, Pi / 2);
 	target.model.rotation = R;
 
-	reset_target_position();
-
 	// initialize the force arrow mesh
 	// force arrow initially from (0,0,0) to (1,0,0)
 
@@ -136,15 +149,6 @@ void scene_structure::initialize()
 
 	reset_force();
 
-	// initialize the skybox (code from the cgp examples)
-
-	image_structure image_skybox_template = image_load_file(project::path+"assets/skybox.jpg");
-	std::vector<image_structure> image_grid = image_split_grid(image_skybox_template, 4, 3);
-
-	skybox.initialize_data_on_gpu();
-	skybox.texture.initialize_cubemap_on_gpu(image_grid[1], image_grid[7], image_grid[5], image_grid[3], image_grid[10], image_grid[4]);
-	skybox.model.rotation = cgp::rotation_axis_angle({1,0,0}, Pi/2);
-
 	// initialize the curve for the parabola: it's actually a chain of N segments going from (0,0,0) to (1,0,0) in a straight line
 	// then, the actual parabola will be computed in the vertex shader to avoid copying data to the GPU each frame
 	// we'll just need to pass the position, force & gravity as uniforms
@@ -167,94 +171,191 @@ void scene_structure::initialize()
 	std::cout << general_message;
 }
 
-void scene_structure::simulation_step(float dt)
+void scene_structure::initialize_terrain_on_gpu()
 {
-	if (phase > 0)
-		return;
+	if (level_cached)
+		std::cout << "Level read from " << level_files.file_name(terrain, N_terrain_samples, terrain_length, n_bumps) << " in " << level_files.last_load_time << " ms" << std::endl;
 
-	float m = 0.01f;       		// ball mass
-	vec3 g = { 0,0,-gravity}; 	// gravity
+	if (!terrain.height_cache.empty())
+		std::cout << "Terrain height cache: " << height_cache_resolution << "x" << height_cache_resolution << " samples, max error " << terrain.cache_max_error << "\n" << std::endl;
+
+	if (terrain_tiled)
+	{
+		terrain_tiles.set_resolution(N_terrain_samples);
+		terrain_tiles.n_threads = terrain_build_threads;
+		terrain_tiles.initialize_data_on_gpu(terrain, shader_custom);
+	}
+#ifndef __EMSCRIPTEN__
+	else if (terrain_gpu_generation)
+	{
+		// allocate the buffers with a flat grid, then compute the vertices on the GPU and compare them with the CPU heights
+		terrain_mesh.initialize_data_on_gpu(terrain_grid_mesh(N_terrain_samples, terrain_length));
+		terrain_mesh.shader = shader_custom;
+		terrain_mesh.material.color = {1, 1, 1};
+
+		terrain_generator.initialize(project::path + "shaders/terrain_generation/terrain_generation.vert.glsl");
+		terrain_generator.generate(terrain, terrain_mesh);
+
+		float error = 0.0f;
+		bool const ok = terrain_generator.readback_check(terrain, terrain_mesh, &error);
+		std::cout << "Terrain generated on the GPU, max relative height difference with the CPU: " << error
+			<< " (bound " << terrain_gpu_generator::readback_bound << ") " << (ok ? "ok" : "FAILED") << std::endl;
+		if (!ok)
+			std::cerr << "Error: the terrain generated on the GPU does not match the CPU terrain (physics and display disagree)" << std::endl;
+	}
+#endif
+	else
+	{
+		terrain_build_timing const& t = terrain.build_timing;
+		if (!level_cached)
+			std::cout << "Terrain mesh (" << N_terrain_samples << "x" << N_terrain_samples << " samples) built on " << t.n_threads << " threads in " << t.total << " ms"
+				<< " (heights " << t.heights << " ms, triangles " << t.indices << " ms, normals " << t.normals << " ms)" << std::endl;
+
+		terrain_mesh.initialize_data_on_gpu(terrain.mesh);
+		terrain_mesh.shader = shader_custom;
+		terrain_mesh.material.color = {1, 1, 1};
+	}
+}
 
+void scene_structure::initialize_level()
+{
+	// initialize the camera
 
-	ball_weight = m * g;
-	ball_force = ball_weight;
+	camera_control.camera_model.position_camera = {-10, -10, terrain.get_height(-10,-10) + 10};
 
-	ball_velocity = ball_velocity + dt * ball_force / m;
-	check_target_hit(ball_position, ball_position + dt * ball_velocity);
-	ball_position = ball_position + dt * ball_velocity;
+	// initialize the position & speed of the ball (this also moves the camera to look at the ball)
+	
+	reset_position();
 
-	vec3 normal = terrain.get_normal_from_position(terrain.N, terrain.terrain_length, ball_position.x, ball_position.y);
+	// initialize light meshes, positions, speeds and colors
+	// (n_lights moving lights, one inside the ball, one above the target)
 
-	if (ball_position.z - ball_radius <= terrain.evaluate_terrain_height(ball_position.x, ball_position.y) && dot(ball_velocity, normal) < 0)
-	{
-		// we went under the ground: reflect towards the normal (and reduce the speed norm to lose energy)
-		ball_velocity = 0.8 * reflect(ball_velocity, normal);
-		// stay above the ground
-		ball_position.z = terrain.evaluate_terrain_height(ball_position.x, ball_position.y) + ball_radius;
-
-		// we want the ball to slide down slopes reasonably fast, but not gain too much speed (otherwise, it falls with a constant & low speed)
-		// but also not enter infinite loops so we stop it after 5 seconds
-		if (normal.z < 0.995 && cgp::norm(ball_velocity) < 3 && timer.t - last_action_time < 5)
-			ball_velocity = 1.3 * ball_velocity;
-
-		// if 10 seconds have passed, we stop once it's slow enough (otherwise, it can get boring)
-		if (timer.t - last_action_time > 10 && norm(ball_velocity) < 0.5)
-		{
-			ball_velocity = {0,0,0};
-			ball_position.z = terrain.evaluate_terrain_height(ball_position.x, ball_position.y) + ball_radius;
-		}
-	}
+	light_colors.resize(n_lights+2);
+	sphere_radii.assign(n_lights+2, 0.5f);
+
+	random_stream const lights_random = world_random.split(random_lights);
+	for (int i = 0; i < n_lights; i++)
+		light_colors[i] = get_random_color(lights_random.split(0), i);
+
+	// avoid spawning lights too close to the walls and spawn them slightly above ground
+	swarm.initialize(terrain, n_lights, terrain_length / 2.2f, lights_random.split(1));
+
+	// initialize the position of the light inside the ball, and the light above the target
+	// (they're special lights so they aren't included in n_lights)
+
+	// red light of the ball
+	light_colors[n_lights] = {1.0f, 0, 0};
+	sphere_radii[n_lights] = 0.2f;
+
+	// blue light above the target	
+	light_colors[n_lights+1] = {0, 0, 1.0f};
+	sphere_radii[n_lights+1] = 0.2f;
+
+	reset_target_position();
+}
+
+void scene_structure::simulation_step(float dt)
+{
+	if (phase > 0)
+		return;
+
+	if (physics.step(terrain, dt))
+		target_hit();
 }
 
 void scene_structure::display_frame()
 {
-	// Update time
-	timer.update();
+	// Update time (by a fixed step in the deterministic replays)
+	if (fixed_time_step > 0)
+		timer.t += fixed_time_step;
+	else
+		timer.update();
 
 	if (last_frame_time == -1.0f)			// avoid a massive interval during the first frame
 		last_frame_time = timer.t;
 
 	float interval = timer.t - last_frame_time;
 	last_frame_time = timer.t;
+
+	// startup: only the background is displayed until all the assets are on the GPU
+	if (!level_ready)
+	{
+		assets.process_uploads(asset_upload_budget);
+		if (!assets.finished())
+			return;
+
+		level_ready = true;
+		std::cout << "Assets ready in " << assets.total_time << " ms:" << std::endl;
+		for (asset_timing const& t : assets.timings)
+			std::cout << "  " << t.name << ": load " << t.load << " ms (started after " << t.wait << " ms), upload " << t.upload << " ms, ready after " << t.ready << " ms" << std::endl;
+		std::cout << std::endl;
+	}
 	
 	// move the camera (no longer necessary with the first person camera structure)
 	// move_cam(interval);
 
-	update_light_pos(interval);
-	simulation_step(timer.scale * 0.1f);
+	profiler.begin(stage_update);
+	swarm.update(terrain, interval);
+
+	// fixed-timestep physics: run as many steps as the elapsed time requires (at most max_substeps, the rest is dropped)
+	float const physics_dt = 1.0f / physics_rate;
+	int n_steps = 0;
+
+	physics_accumulator += interval;
+	while (physics_accumulator >= physics_dt && n_steps < max_substeps)
+	{
+		previous_ball_position = physics.ball.position;
+		simulation_step(physics.parameters.simulation_speed * physics_dt);
+		physics_accumulator -= physics_dt;
+		n_steps++;
+
+		// stop the ball if it's going slow & near the ground (and in the movement phase), checked after every step as in simulate_shot
+		if (phase == 0 && physics.try_stop(terrain))
+		{
+			phase++;
+			last_action_time = timer.t;
+			reset_force();
+
+			if (reachability_check)
+				start_shot_search();
+			break;
+		}
+	}
+	physics_accumulator = std::min(physics_accumulator, physics_dt);
+
+	// the ball is drawn between the last two physics states
+	float alpha = physics_accumulator / physics_dt;
+	vec3 ball_render_position = phase == 0 ? (1 - alpha) * previous_ball_position + alpha * physics.ball.position : physics.ball.position;
+	profiler.end();
 
 	// draw the skybox before everything else
+	profiler.begin(stage_skybox);
 	glDepthMask(GL_FALSE);
 	draw(skybox, environment);
 	glDepthMask(GL_TRUE);
+	profiler.end();
 
 	// if (gui.display_frame)
 	// 	draw(global_frame, environment);
 
-	draw(terrain_mesh, environment);
-
-	ball.model.translation = ball_position;
-	draw(ball, environment);
-
-	draw(target, environment);
-
 	// the first n_lights are regular lights, the last 2 follow the ball and the target
-	glUseProgram(shader_custom.id);
-
 	// if the ball went through the target in the last 5 seconds, we want to display a pretty win animation
+	profiler.begin(stage_light_upload);
 	bool is_win_animation = last_win_time != -1.0f && timer.t - last_win_time <= 5;
+	float const dl_max = is_win_animation ? 100 : 30;
 
-	environment.uniform_generic.uniform_float["ambiant"] = 1.0f / n_lights;
-	environment.uniform_generic.uniform_float["diffuse"] = 5.f / n_lights;
-	environment.uniform_generic.uniform_float["specular"] = 35.f / n_lights;
-	environment.uniform_generic.uniform_float["specular_exp"] = 100;
-	environment.uniform_generic.uniform_float["dl_max"] = is_win_animation ? 100 : 30;
-
-	environment.uniform_generic.uniform_int["light_n"] = n_lights + 2;
+	frame_uniform_data& frame = environment.frame_data;
+	frame.ambiant = 1.0f / n_lights;
+	frame.diffuse = 5.f / n_lights;
+	frame.specular = 35.f / n_lights;
+	frame.specular_exp = 100;
+	frame.dl_max = dl_max;
+	frame.arena_length = lights_gpu.arena_length;
+	frame.cluster_resolution = lights_gpu.resolution;
+	frame.data_width = lights_gpu.texture_width;
 
-	// we need to use a bit of raw OpenGL to access uniform arrays in the shaders
-	GLint pos_loc = shader_custom.query_uniform_location("light_positions");
-	GLint col_loc = shader_custom.query_uniform_location("light_colors");
+	std::vector<vec3> frame_light_pos(n_lights + 2);
+	std::vector<vec3> frame_light_colors(n_lights + 2);
 
 	for (int i = 0; i < n_lights; i++)
 	{		
@@ -267,35 +368,45 @@ void scene_structure::display_frame()
 			color = {(i + nb) % 3 == 0, (i + nb) % 3 == 1, (i + nb) % 3 == 2};
 		}
 
-		cgp::vec3 pos = light_pos[i];
-
-		glUniform3f(pos_loc + i, pos.x, pos.y, pos.z);
-		glUniform3f(col_loc + i, color.x, color.y, color.z);
-
-		spheres[i].model.translation = pos;
+		frame_light_pos[i] = swarm.position(i);
+		frame_light_colors[i] = color;
 	}
 
 	// Ball light (inside the ball)
-	cgp::vec3 color1 = light_colors[n_lights];
-	cgp::vec3 pos1 = ball_position;
+	frame_light_pos[n_lights] = ball_render_position;
+	frame_light_colors[n_lights] = light_colors[n_lights];
 
-	glUniform3f(pos_loc + n_lights, pos1.x, pos1.y, pos1.z);
-	glUniform3f(col_loc + n_lights, color1.x, color1.y, color1.z);
+	// Target light
+	frame_light_pos[n_lights+1] = target.model.translation + vec3{0, 0, 5.0f};
+	frame_light_colors[n_lights+1] = light_colors[n_lights+1];
 
-	spheres[n_lights].model.translation = pos1;
+	spheres.update_instances(frame_light_pos, sphere_radii, light_colors);
 
-	// Target light
-	cgp::vec3 color2 = light_colors[n_lights+1];
-	cgp::vec3 pos2 = target.model.translation;
-	pos2.z = pos2.z + 5.0f;
+	// lists of the lights reaching each cluster of the arena, read by shader_custom
+	lights_gpu.update(frame_light_pos, frame_light_colors, dl_max);
+	lights_gpu.bind(1);
+
+	// camera and lighting parameters: one buffer update for all the draw calls of the frame
+	environment.update_frame_uniform_buffer();
+	profiler.end();
 
-	glUniform3f(pos_loc + n_lights+1, pos2.x, pos2.y, pos2.z);
-	glUniform3f(col_loc + n_lights+1, color2.x, color2.y, color2.z);
+	profiler.begin(stage_terrain);
+	if (terrain_tiled)
+		terrain_tiles.draw(terrain, environment, camera_control.camera_model.position(), float(window.height));
+	else
+		draw(terrain_mesh, environment);
+	profiler.end();
 
-	spheres[n_lights+1].model.translation = pos2;
+	profiler.begin(stage_ball_target);
+	ball.model.translation = ball_render_position;
+	draw(ball, environment);
+
+	draw(target, environment);
+	profiler.end();
 
-	for (mesh_drawable& sphere: spheres)
-		draw(sphere, environment);
+	profiler.begin(stage_light_spheres);
+	spheres.draw(environment);
+	profiler.end();
 
 	// if (gui.display_wireframe)
 	// 	draw_wireframe(terrain_mesh, environment);
@@ -327,12 +438,13 @@ void scene_structure::display_frame()
 	// draw the force arrow and the parabola if the ball isn't currently in its movement phase
 	if (phase > 0)
 	{
+		profiler.begin(stage_arrow_parabola);
 		cgp::rotation_transform rot = cgp::rotation_axis_angle({0, 0, 1}, angle_phi) * cgp::rotation_axis_angle({0, 1, 0}, -angle_theta);
 		kick_direction = rot * vec3{1, 0, 0};
 
 		force_arrow.model.rotation = rot;
 		force_arrow.model.scaling = 2 * force_strength;
-		force_arrow.model.translation = ball_position + kick_direction * 2;
+		force_arrow.model.translation = physics.ball.position + kick_direction * 2;
 		draw(force_arrow, environment);
 
 		glUseProgram(shader_parabola.id);
@@ -340,24 +452,17 @@ void scene_structure::display_frame()
 		// apparently, glLineWidth isn't supported anymore on modern devices... shame
 
 		// give the vertex shader the necessary information to compute the shape of the parabola
-		environment.uniform_generic.uniform_vec3["ball_position"] = ball_position;
-		environment.uniform_generic.uniform_vec3["kickforce"] = kick_direction * force_strength * force_coef;
-		environment.uniform_generic.uniform_float["gravity"] = gravity;
+		environment.uniform_generic.uniform_vec3["ball_position"] = physics.ball.position;
+		environment.uniform_generic.uniform_vec3["kickforce"] = kick_direction * force_strength * physics.parameters.force_coef;
+		environment.uniform_generic.uniform_float["gravity"] = physics.parameters.gravity;
 
 		environment.uniform_generic.uniform_vec3["segment_color"] = {1., 0., 0.};
 
 		draw(segments, environment);
+		profiler.end();
 	}
 
-	// stop the ball if it's going slow & near the ground (and in the movement phase)
-	if (phase == 0 && cgp::norm(ball_velocity) < stop_threshold && ball_position.z <= terrain.evaluate_terrain_height(ball_position.x, ball_position.y) + 1.5 * ball_radius)
-	{
-		phase++;
-		ball_position.z = terrain.evaluate_terrain_height(ball_position.x, ball_position.y) + ball_radius;
-		ball_velocity = {0, 0, 0};
-		last_action_time = timer.t;
-		reset_force();
-	}
+	update_shot_search();
 
 	// we want the camera to stay inside the arena (x & y between -boundary and boundary), above the ground (z >= height of ground + 1) and with a correct "up" vector
 
@@ -366,7 +471,7 @@ void scene_structure::display_frame()
 
 	campos.x = std::max(std::min(campos.x, boundary), -boundary);
 	campos.y = std::max(std::min(campos.y, boundary), -boundary);
-	campos.z = std::max(campos.z, terrain.evaluate_terrain_height(campos.x, campos.y) + 1.f);
+	campos.z = std::max(campos.z, terrain.get_height(campos.x, campos.y) + 1.f);
 
 	camera_control.camera_model.position_camera = campos;
 
@@ -378,8 +483,16 @@ void scene_structure::display_frame()
 
 void scene_structure::display_gui()
 {
-	// we do not need gui parameters
-	return;
+	if (!level_ready)
+		ImGui::Text("Loading assets (%d/%d)...", int(assets.timings.size()), assets.size());
+
+	if (level_ready && terrain_tiled)
+	{
+		ImGui::Text("Terrain tiles: %d drawn (%d vertices), %d resident", terrain_tiles.drawn_tiles, terrain_tiles.drawn_vertices, terrain_tiles.resident_tiles);
+		ImGui::Text("  this frame: %d built, %d evicted", terrain_tiles.built_tiles, terrain_tiles.evicted_tiles);
+	}
+
+	profiler.display_gui();
 }
 
 void scene_structure::reset_force()
@@ -395,11 +508,10 @@ void scene_structure::space_pressed()
 	// increase the phase (do nothing if phase = 0)
 	if (phase == 1 || phase == 2)
 	{
-		timer.update();
-		last_action_time = timer.t;
+		last_action_time = current_time();
 		phase++;
 	}
-	else if (phase == 3)
+	else if (phase == 3 || phase == 4)
 		launch();
 }
 
@@ -408,15 +520,23 @@ void scene_structure::reset_position()
 	// reset the ball position to a random point (above the ground)
 
 	float boundary = terrain_length * 0.4;
-	ball_position = {cgp::rand_uniform(-boundary, boundary), cgp::rand_uniform(-boundary, boundary), 0};
-	ball_position.z = terrain.evaluate_terrain_height(ball_position.x, ball_position.y) + 15 * ball_radius;
-	ball_velocity = {0.f, 0.f, 0.f};
+	float const ball_radius = physics.parameters.ball_radius;
+	vec3 ball_position = {placement_random.uniform(-boundary, boundary), placement_random.uniform(-boundary, boundary), 0};
+	float ground_height = terrain.get_height(ball_position.x, ball_position.y);
+	ball_position.z = ground_height + 15 * ball_radius;
+
+	// the ball falls from above the ground
+	physics.reset(ball_position, true);
+	previous_ball_position = ball_position;
 
 	cgp::vec3 look_at_pos = ball_position;
-	look_at_pos.z = terrain.evaluate_terrain_height(ball_position.x, ball_position.y) + 3 * ball_radius;
+	look_at_pos.z = ground_height + 3 * ball_radius;
 
 	camera_control.look_at(camera_control.camera_model.position_camera, look_at_pos, {0,0,1});
 	phase = 0;
+
+	solver.cancel();
+	shot_search_valid = false;
 }
 
 void scene_structure::reset_target_position()
@@ -424,81 +544,166 @@ void scene_structure::reset_target_position()
 	// reset the target position to a random point
 	float boundary = terrain_length * 0.4;
 
-	vec3 pos = {cgp::rand_uniform(-boundary, boundary), cgp::rand_uniform(-boundary, boundary), 0};
-	pos.z = terrain.evaluate_terrain_height(pos.x, pos.y) + torus_max_radius;
+	vec3 pos = {placement_random.uniform(-boundary, boundary), placement_random.uniform(-boundary, boundary), 0};
+	pos.z = terrain.get_height(pos.x, pos.y) + torus_max_radius;
 
 	target.model.translation = pos;
+	physics.target_position = pos;
+
+	// the previous search does not apply to this target
+	solver.cancel();
+	shot_search_valid = false;
+	if (phase > 0 && reachability_check)
+		start_shot_search();
 }
 
 
-void scene_structure::launch()
+void scene_structure::new_level()
 {
-	// launch the ball after the force has been chosen
+	// generate new bumps (and the CPU mesh if it is used), then update what is drawn
+	solver.cancel();
+	level++;
+	terrain.random = world_random.split(random_terrain).split(level);
+	terrain.create_terrain_mesh(N_terrain_samples, terrain_length, n_bumps);
 
-	phase = 0;
-	ball_velocity = kick_direction * force_strength * force_coef;
-	timer.update();
-	last_action_time = timer.t;
+	if (terrain_tiled)
+		terrain_tiles.initialize_data_on_gpu(terrain, shader_custom);
+#ifndef __EMSCRIPTEN__
+	else if (terrain_gpu_generation)
+		terrain_generator.generate(terrain, terrain_mesh);
+#endif
+	else
+	{
+		int const n_vertices = terrain.mesh.position.size();
+		update_vbo_range(terrain_mesh, "position", terrain.mesh.position, 0, n_vertices);
+		update_vbo_range(terrain_mesh, "normal", terrain.mesh.normal, 0, n_vertices);
+	}
+
+	reset_position();
+	reset_target_position();
 }
 
-void scene_structure::update_light_pos(float time_passed)
+void scene_structure::sculpt()
 {
-	// update the lights positions & speeds
-	// every frame, we randomly change every speed by a small vector to make them move smoothly but also randomly
-	// we always assume the speeds to be normalized
+	// march along the view direction until we go below the ground
+	vec3 p = camera_control.camera_model.position();
+	vec3 front = camera_control.camera_model.front();
 
-	const float speed = 3.;			// actual speed of the ball
+	for (float d = 0; d < terrain_length; d += 0.5f)
+	{
+		vec3 q = p + d * front;
+		if (q.z <= terrain.get_height(q.x, q.y))
+		{
+			// the search reads the terrain: stop it during the edit, and restart it on the new terrain
+			solver.cancel();
+			apply_terrain_edit(terrain.add_bump({q.x, q.y}, 4.0f, 4.0f));
+			shot_search_valid = false;
+			if (phase > 0 && reachability_check)
+				start_shot_search();
+			return;
+		}
+	}
+}
 
-	// coefficients of actual speed, direction towards the ball, c3 = 1 - c1 - c2 random direction
-	// actually, it seems better to use a random direction without considering the ball
-	// (at first, we wanted the lights to go towards the ball in a menacing way)
+void scene_structure::apply_terrain_edit(terrain_region const& region)
+{
+	if (terrain_tiled)
+		terrain_tiles.update_area(terrain, region.x_min, region.x_max, region.y_min, region.y_max);
+#ifndef __EMSCRIPTEN__
+	else if (terrain_gpu_generation)
+		terrain_generator.generate(terrain, terrain_mesh);
+#endif
+	else
+	{
+		// each row of the region is contiguous in the buffers
+		int const count = region.kv_max - region.kv_min + 1;
+		for (int ku = region.ku_min; ku <= region.ku_max; ku++)
+		{
+			update_vbo_range(terrain_mesh, "position", terrain.mesh.position, region.kv_min + terrain.N * ku, count);
+			update_vbo_range(terrain_mesh, "normal", terrain.mesh.normal, region.kv_min + terrain.N * ku, count);
+		}
+	}
+}
 
-	const float c1 = 0.95, c2 = 0.0;
+void scene_structure::launch()
+{
+	// launch the ball after the force has been chosen
 
-	for (int i = 0; i < n_lights; i++)
-	{
-		light_speed[i] = cgp::normalize(c1 * light_speed[i] + c2 * cgp::normalize(ball_position - light_pos[i]) + (1-c1-c2) * get_random_normalized());
+	phase = 0;
+	physics.launch(kick_direction, force_strength);
+	last_action_time = current_time();
 
-		light_pos[i] += time_passed * speed * light_speed[i];
-		
-		// if balls are getting to close to the walls, we reverse the corresponding speed coordinate
-		// no need to re-normalize the speed
+	solver.cancel();
+	shot_search_valid = false;
+	aim_assist_requested = false;
+}
 
-		if ((light_pos[i].x > terrain.terrain_length / 2.2 && light_speed[i].x > 0) || (light_pos[i].x < -terrain.terrain_length / 2.2 && light_speed[i].x < 0))
-			light_speed[i].x = -light_speed[i].x;
+void scene_structure::start_shot_search()
+{
+	shot_search_valid = false;
+	solver.physics_rate = physics_rate;		// same steps as the game
+	solver.start(terrain, physics.parameters, physics.ball.position, physics.target_position);
+}
 
-		if ((light_pos[i].y > terrain.terrain_length / 2.2 && light_speed[i].y > 0) || (light_pos[i].y < -terrain.terrain_length / 2.2 && light_speed[i].y < 0))
-			light_speed[i].y = -light_speed[i].y;
+void scene_structure::update_shot_search()
+{
+	if (!solver.poll(shot_search))
+		return;
+	shot_search_valid = true;
 
-		light_pos[i].z = terrain.evaluate_terrain_height(light_pos[i].x, light_pos[i].y) + 3.;
-	}
+	if (shot_search.reachable)
+		std::cout << "The target can be reached (" << shot_search.n_candidates << " shots tried in " << shot_search.time << " ms), press H for the aim assist" << std::endl;
+	else if (shot_search.complete)
+		std::cout << "No shot reaching the target was found (" << shot_search.n_candidates << " shots tried in " << shot_search.time << " ms), press P to move it" << std::endl;
+	else
+		std::cout << "No shot reaching the target was found, but the search was incomplete (" << shot_search.n_candidates << " shots tried in " << shot_search.time << " ms) and one may still exist: press H to aim at the closest miss, or P to move the target" << std::endl;
+
+	if (aim_assist_requested)
+		aim_assist();
 }
 
-void scene_structure::check_target_hit(vec3 old_pos, vec3 new_pos)
+void scene_structure::aim_assist()
 {
-	// check whether the target was hit (if it's the case, update last_win_time and display a message)
+	if (phase == 0)
+		return;
 
-	// recall that the target is always facing the y axis (that is, a {0,1,0} vector is going through the hole)
-	
-	vec3 target_pos = target.model.translation;
+	// the search is started on demand if the automatic check is disabled
+	if (!shot_search_valid)
+	{
+		aim_assist_requested = true;
+		if (!solver.running())
+			start_shot_search();
+		return;
+	}
+	aim_assist_requested = false;
 
-	// first condition: we need to go from one side of the y plane to another, ie. the sign of (pos.y - target.y) has changed
-	if ((new_pos.y - target_pos.y) * (old_pos.y - target_pos.y) >= 0)
+	// without a hit, the closest miss is still the best starting point, unless the search proved that the target is unreachable
+	if (shot_search.best_shots.empty() || (!shot_search.reachable && shot_search.complete))
 		return;
 
-	// then, we compute the position of the intersection point (pos.y == target.y)
-	vec3 intersection = old_pos + (new_pos - old_pos) * (target_pos.y - old_pos.y) / (new_pos.y - old_pos.y);
+	shot_candidate const& best = shot_search.best_shots[0];
+	angle_phi = best.angle_phi;
+	angle_theta = best.angle_theta;
+	force_strength = best.force_strength;
+	phase = 4;
+}
 
-	// and we just have to check if the distance from the intersection point to the center of the target is <= the target radius
-	if (cgp::norm(intersection - target_pos) <= torus_max_radius)
-	{
-		std::cout << "\nCongratulations!\n\n";
-		
-		reset_target_position();
-		
+void scene_structure::target_hit()
+{
+	// update last_win_time (for the animation), display a message and move the target
+	std::cout << "\nCongratulations!\n\n";
+
+	reset_target_position();
+
+	last_win_time = current_time();
+}
+
+float scene_structure::current_time()
+{
+	// with a fixed time step, the time only advances at the start of each frame
+	if (fixed_time_step <= 0)
 		timer.update();
-		last_win_time = timer.t;
-	}
+	return timer.t;
 }
 
 void scene_structure::mouse_move_event()
@@ -4,6 +4,18 @@
 #include "cgp/cgp.hpp"
 #include "environment.hpp"
 #include "terrain.hpp"
+#include "terrain_tiles.hpp"
+#include "terrain_gpu.hpp"
+#include "simulation.hpp"
+#include "shot_solver.hpp"
+#include "light_clusters.hpp"
+#include "instanced_spheres.hpp"
+#include "light_swarm.hpp"
+#include "level_cache.hpp"
+#include "asset_loader.hpp"
+#include "cooked_cubemap.hpp"
+#include "program_cache.hpp"
+#include "frame_profiler.hpp"
 
 // This definitions allow to use the structures: mesh, mesh_drawable, etc. without mentionning explicitly cgp::
 using cgp::mesh;
@@ -23,6 +35,9 @@ const std::string general_message =
 	"\t- W/S, A/D, R/F: move the camera position front/back, left/right and up/down\n"
 	"\t- left click + drag: move the camera view\n"
 	"\t- P: reset the target position (use it if the target is legitimately unreachable)\n"
+	"\t- N: generate a new level\n"
+	"\t- B: raise a bump where the camera looks\n"
+	"\t- H: aim assist (once the ball has stopped: the best shot found, or the closest miss if the search was incomplete)\n"
 	"\n"
 	"Hint: if you do not know where the target/ball is, seek a blue/red light!\n"
 	"If you're very unlucky, the target may not be reachable; then, use T to reset the ball position or P to reset the target position.\n\n";
@@ -33,6 +48,20 @@ struct gui_parameters {
 	bool display_wireframe = false;
 };
 
+// Stages of a frame measured by the profiler (in the order of the frame)
+enum profiler_stage {
+	stage_update,			// lights and physics
+	stage_skybox,
+	stage_light_upload,		// light spheres instances, light clusters and frame uniform buffer
+	stage_terrain,
+	stage_ball_target,
+	stage_light_spheres,
+	stage_arrow_parabola,
+	stage_imgui
+};
+// names of the stages, in the order of profiler_stage
+const std::vector<std::string> profiler_stage_names = {"simulation, lights", "skybox", "light upload", "terrain", "ball, target", "light spheres", "arrow, parabola", "ImGui"};
+
 // The structure of the custom scene
 struct scene_structure : cgp::scene_inputs_generic {
 	
@@ -45,33 +74,61 @@ struct scene_structure : cgp::scene_inputs_generic {
 	window_structure window;
 	opengl_shader_structure shader_custom;		// shader with Phong lighting
 	opengl_shader_structure shader_parabola;	// shader allowing to dynamically compute a parabolic shape
+	program_cache programs;						// binaries of the linked shader programs (default shaders included), read from cache/shaders/
 
 	mesh_drawable global_frame;          // The standard global frame
 	environment_structure environment;   // Standard environment controler
 	input_devices inputs;                // Storage for inputs status (mouse, keyboard, window dimension)
 	gui_parameters gui;                  // Standard GUI element storage
+	frame_profiler profiler;             // CPU and GPU time of the stages of the frame (see profiler_stage)
 
 	// ****************************** //
 	// Elements and shapes of the scene
 	// ****************************** //
 
+	// World generation: the terrain, the lights and the placements are drawn from independent streams of the seed (see random.hpp)
+	uint64_t seed = 0;						// set by main (option --seed)
+	int level = 0;							// number of levels generated since initialize
+	random_stream world_random;				// stream of the seed
+	random_stream placement_random;			// positions of the ball and the target
+
 	Terrain terrain;
+	level_cache level_files;				// the first level is read from this cache when it was already generated (same seed and parameters)
 	cgp::mesh_drawable terrain_mesh;
+	terrain_tiles_drawable terrain_tiles;	// used instead of terrain_mesh when terrain_tiled is true
+	terrain_gpu_generator terrain_generator;	// fills terrain_mesh on the GPU when terrain_gpu_generation is true
 	timer_basic timer;
+	float fixed_time_step = 0;				// if > 0, the time advances by this amount every frame instead of following the clock (deterministic replays)
 
 	int n_lights = 10;
 
-	std::vector<mesh_drawable> spheres;		// the spheres associated to the lights
+	opengl_shader_structure shader_instanced_sphere;	// shader of the light spheres (instanced)
+	instanced_spheres_drawable spheres;		// the spheres associated to the lights (one instance per light)
+	std::vector<float> sphere_radii;		// radius of each sphere
 
 	std::vector<cgp::vec3> light_colors;
-	std::vector<cgp::vec3> light_pos;
-	std::vector<cgp::vec3> light_speed;
+	light_swarm swarm;						// positions and directions of the n_lights moving lights
+
+	light_clusters lights_gpu;				// lights sent to shader_custom, grouped by clusters of the arena
+	int light_cluster_resolution = 32;		// number of clusters along one coordinate
 
 	cgp::skybox_drawable skybox;
+	std::vector<cgp::image_structure> skybox_faces;	// decoded by the asset loader, released once sent to the GPU
+	cooked_cubemap skybox_cooked;			// faces and mipmaps of the skybox, read from cache/ (cooked from assets/skybox.jpg at the first launch)
+
+	// Assets prepared in the background at startup (terrain and skybox): the level starts when they are all on the GPU
+	asset_loader assets;
+	float asset_upload_budget = 4.0f;		// time per frame spent sending the loaded assets to the GPU (in milliseconds)
+	bool level_ready = false;				// all the assets are uploaded (until then, the level is neither drawn nor updated)
+	bool level_cached = false;				// the first level was read from level_files
 
 	int N_parabola = 100;			// number of points in the parabola
 	int N_terrain_samples = 150;	// number of points in the terrain mesh (along one coordinate)
 	int n_bumps = 60;					// number of bumps in the terrain
+	int terrain_build_threads = 0;		// number of threads used to build the terrain mesh (0 = all the hardware threads)
+	bool terrain_gpu_generation = false;	// compute the vertices of terrain_mesh on the GPU (ignored with terrain_tiled)
+	bool terrain_tiled = false;			// draw the terrain with tiles (LOD + frustum culling), for large values of N_terrain_samples
+	int height_cache_resolution = 512;	// number of samples of the terrain height cache (along one coordinate), <= 1 to disable it
 	float terrain_length = 100;		// length of the terrain
 
 	mesh_drawable ball;				// sphere ball mesh
@@ -80,17 +137,17 @@ struct scene_structure : cgp::scene_inputs_generic {
 	curve_drawable segments;		// from (0,0,0) to (1,0,0) (positions modified in the vertex shader)
 
 	// Ball parameters
-	vec3 ball_position;
-	vec3 ball_velocity;
-	vec3 ball_force;
-	vec3 ball_weight;
+	ball_simulation physics;		// ball, target and physics constants
+	vec3 previous_ball_position;	// position before the last physics step (the ball is drawn between the two)
 
-	const float force_coef = 6;				// multiply the force strength (shown visually) by this value
-	const float gravity = 9.81 * 0.4f;		// gravity force (reduced)
+	// Physics time step: the simulation runs physics_rate steps per second, whatever the frame rate
+	float physics_rate = 60.0f;				// number of physics steps per second
+	int max_substeps = 8;					// maximal number of steps per frame (beyond, the simulation slows down instead of freezing the frame)
+	float physics_accumulator = 0.0f;		// time not yet simulated
 
 	// phase = 0 when the ball is moving (no user interaction), 1 when choosing a horizontal angle for the kick,
-	// 2 when choosing a vertical angle for the kick, 3 when choosing the strength.
-	int phase;
+	// 2 when choosing a vertical angle for the kick, 3 when choosing the strength, 4 when the kick was set by the aim assist.
+	int phase = 0;
 	float angle_phi = 0.f;			// when choosing the force, horizontal angle
 	float angle_theta = Pi / 4;		// when choosing the force, vertical angle
 	float force_strength = 1.0f;	// when choosing the force, strength of the force
@@ -99,11 +156,14 @@ struct scene_structure : cgp::scene_inputs_generic {
 	float last_frame_time = -1.0f;	// updated every frame to know how much time has passed
 	float last_win_time = -1.0f;	// updated every time the ball goes through the target (to show the win animation)
 
-	vec3 kick_direction;			// unit vector along the kick direction
-
-	float stop_threshold = 0.2;		// stop when the norm of the speed is lower than this mount
+	// Search of the shots reaching the target, started in the background every time the ball stops
+	shot_solver solver;
+	bool reachability_check = true;		// start the search automatically (and tell whether the target is reachable)
+	bool aim_assist_requested = false;	// H was pressed: apply the best shot as soon as it is known
+	shot_solver_result shot_search;		// result of the last search
+	bool shot_search_valid = false;		// the result corresponds to the current ball and target positions
 
-	float ball_radius = 1.0f;
+	vec3 kick_direction;			// unit vector along the kick direction
 
 	float torus_max_radius = 2.2f;
 	float torus_min_radius = 0.2f;
@@ -113,9 +173,10 @@ struct scene_structure : cgp::scene_inputs_generic {
 	// ****************************** //
 
 	void simulation_step(float dt);
-	cgp::vec3 reflect(cgp::vec3 v, cgp::vec3 n);
 
 	void initialize();    // Standard initialization to be called before the animation loop
+	void initialize_terrain_on_gpu();	// (on the OpenGL thread, once the terrain is generated)
+	void initialize_level();			// ball, target and lights of the first level (once the terrain is on the GPU)
 	void display_frame(); // The frame display to be called within the animation loop
 	void display_gui();   // The display of the GUI, also called within the animation loop
 
@@ -123,10 +184,16 @@ struct scene_structure : cgp::scene_inputs_generic {
 	void space_pressed();				// to be called when the user presses space
 	void reset_position();				// to be called when the user presses T, resets the position of the ball
 	void reset_target_position();		// to be called at initialization & after each win
+	void new_level();					// to be called when the user presses N, generates a new terrain
+	void sculpt();						// to be called when the user presses B, raises a bump where the camera looks
+	void apply_terrain_edit(terrain_region const& region);	// send the modified part of the terrain to the GPU
 
 	void launch();						// launch the ball
-	void update_light_pos(float time_passed);				// update the light positions
-	void check_target_hit(vec3 old_pos, vec3 new_pos);		// check whether the ball went through the target
+	void start_shot_search();			// search the shots reaching the target from the current ball position (in the background)
+	void update_shot_search();			// to be called every frame, handles the end of the search
+	void aim_assist();					// to be called when the user presses H, sets the kick to the best shot found
+	void target_hit();					// to be called when the ball went through the target
+	float current_time();				// time of the scene (timer.t, updated unless the time step is fixed)
 
 	// void move_cam(float time_passed);		// move the camera (with a given real time between the previous frame and the actual one)
 												// no longer necessary with camera_controller_first_person (it re-implemented WASD)
@@ -0,0 +1,227 @@
+#include "shot_solver.hpp"
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+using namespace cgp;
+
+float shot_solver::time_step(simulation_parameters const& parameters) const
+{
+	return parameters.simulation_speed / physics_rate;
+}
+
+int shot_solver::max_steps(simulation_parameters const& parameters) const
+{
+	// each step advances time_since_kick by 1 / physics_rate
+	return int(std::ceil((parameters.slow_stop_delay + stop_margin) * physics_rate));
+}
+
+shot_solver_result shot_solver::solve(Terrain const& terrain, simulation_parameters const& parameters, vec3 const& ball_position, vec3 const& target_position) const
+{
+	auto const t0 = std::chrono::steady_clock::now();
+
+	// cheaper collisions: coarser time of impact (1/64 of a step)
+	simulation_parameters p = parameters;
+	p.collision_bisections = std::min(p.collision_bisections, 6);
+
+	float const dt = time_step(parameters);
+	int const steps_per_candidate = max_steps(parameters);
+	int const n = n_phi * n_theta * n_strength;
+
+	// state of the candidates (structure of arrays), only filled for the simulated ones
+	std::vector<float> phi(n), theta(n), strength(n), closest(n);
+	std::vector<int> steps(n, 0);
+	std::vector<char> hit(n, 0), simulated(n, 0);
+	ball_batch balls;
+	balls.resize(n);
+
+	auto candidate_index = [&](int k_phi, int k_theta, int k_strength) { return k_strength + n_strength * (k_theta + n_theta * k_phi); };
+
+	// simulate the listed candidates until they stop, hit the target or reach max_steps
+	auto simulate = [&](std::vector<int> const& candidates)
+	{
+		parallel_for_bands(int(candidates.size()), n_threads, [&](int begin, int end)
+		{
+			// initial kicks
+			std::vector<int> active(candidates.begin() + begin, candidates.begin() + end);
+			for (int i : active)
+			{
+				int const k_strength = i % n_strength;
+				int const k_theta = (i / n_strength) % n_theta;
+				int const k_phi = i / (n_strength * n_theta);
+
+				phi[i] = 2 * Pi * k_phi / n_phi;
+				theta[i] = Pi / 6 + (Pi / 6) * k_theta / std::max(n_theta - 1, 1);
+				strength[i] = 0.3f + 1.4f * k_strength / std::max(n_strength - 1, 1);
+
+				vec3 direction = {std::cos(theta[i]) * std::cos(phi[i]), std::cos(theta[i]) * std::sin(phi[i]), std::sin(theta[i])};
+				balls.set(i, ball_position, direction * strength[i] * p.force_coef);
+				balls.time_since_kick[i] = 0.0f;
+				closest[i] = norm(ball_position - target_position);
+			}
+
+			// all the moving candidates of the band advance by one step at a time
+			std::vector<char> step_hit;
+			for (int s = 0; s < steps_per_candidate && !active.empty() && !cancelled; s++)
+			{
+				step_hit.resize(active.size());
+				advance_balls(terrain, p, target_position, balls, active.data(), int(active.size()), dt, step_hit.data());
+
+				int n_active = 0;
+				for (int k = 0; k < int(active.size()); k++)
+				{
+					int const i = active[k];
+					steps[i]++;
+					closest[i] = std::min(closest[i], norm(balls.position(i) - target_position));
+
+					ball_state ball;
+					ball.position = balls.position(i);
+					ball.velocity = balls.velocity(i);
+
+					if (step_hit[k])
+					{
+						hit[i] = 1;
+						closest[i] = 0.0f;
+					}
+					else if (!stop_ball(terrain, p, ball))
+						active[n_active++] = i;
+				}
+				active.resize(n_active);
+			}
+		});
+	};
+
+	// ranking: hits before misses, then the fastest hits and the closest misses
+	auto better = [&](int a, int b) {
+		if (hit[a] != hit[b])
+			return hit[a] > hit[b];
+		if (hit[a])
+			return steps[a] < steps[b];
+		return closest[a] < closest[b];
+	};
+
+	// coarse pass
+	int const c_phi = std::max(coarse_phi, 1), c_theta = std::max(coarse_theta, 1), c_strength = std::max(coarse_strength, 1);
+	std::vector<int> coarse;
+	for (int k_phi = 0; k_phi < n_phi; k_phi += c_phi)
+		for (int k_theta = 0; k_theta < n_theta; k_theta += c_theta)
+			for (int k_strength = 0; k_strength < n_strength; k_strength += c_strength)
+				coarse.push_back(candidate_index(k_phi, k_theta, k_strength));
+	for (int i : coarse)
+		simulated[i] = 1;
+	simulate(coarse);
+
+	// fine pass: the candidates of the full grid between the best coarse candidates and their coarse neighbours (phi wraps around)
+	int const n_seeds = std::min(n_refined, int(coarse.size()));
+	std::partial_sort(coarse.begin(), coarse.begin() + n_seeds, coarse.end(), better);
+	std::vector<int> fine;
+	for (int seed = 0; seed < n_seeds && !cancelled; seed++)
+	{
+		int const i = coarse[seed];
+		int const k_strength = i % n_strength;
+		int const k_theta = (i / n_strength) % n_theta;
+		int const k_phi = i / (n_strength * n_theta);
+
+		for (int d_phi = 1 - c_phi; d_phi < c_phi; d_phi++)
+		{
+			for (int d_theta = 1 - c_theta; d_theta < c_theta; d_theta++)
+			{
+				for (int d_strength = 1 - c_strength; d_strength < c_strength; d_strength++)
+				{
+					int const f_theta = k_theta + d_theta, f_strength = k_strength + d_strength;
+					if (f_theta < 0 || f_theta >= n_theta || f_strength < 0 || f_strength >= n_strength)
+						continue;
+					int const f = candidate_index(((k_phi + d_phi) % n_phi + n_phi) % n_phi, f_theta, f_strength);
+					if (!simulated[f])
+					{
+						simulated[f] = 1;
+						fine.push_back(f);
+					}
+				}
+			}
+		}
+	}
+	simulate(fine);
+
+	std::vector<int> order(coarse);
+	order.insert(order.end(), fine.begin(), fine.end());
+	int const n_simulated = int(order.size());
+	int const n_ranked = std::min(std::max(n_best, n_verified), n_simulated);
+	std::partial_sort(order.begin(), order.begin() + n_ranked, order.end(), better);
+
+	std::vector<shot_candidate> ranked;
+	for (int k = 0; k < n_ranked; k++)
+	{
+		int const i = order[k];
+		shot_candidate c;
+		c.angle_phi = phi[i];
+		c.angle_theta = theta[i];
+		c.force_strength = strength[i];
+		c.target_hit = hit[i];
+		c.n_steps = steps[i];
+		c.closest_target_distance = closest[i];
+		ranked.push_back(c);
+	}
+
+	// the best hits are replayed with the exact collisions of the game, and only the confirmed ones are kept as hits
+	for (int k = 0; k < std::min(n_verified, n_ranked) && !cancelled; k++)
+	{
+		shot_candidate& c = ranked[k];
+		if (!c.target_hit)
+			break;
+
+		ball_simulation replay;
+		replay.parameters = parameters;
+		replay.target_position = target_position;
+		replay.reset(ball_position, false);
+
+		vec3 direction = {std::cos(c.angle_theta) * std::cos(c.angle_phi), std::cos(c.angle_theta) * std::sin(c.angle_phi), std::sin(c.angle_theta)};
+		shot_result exact = replay.simulate_shot(terrain, direction, c.force_strength, dt, steps_per_candidate);
+		c.target_hit = exact.target_hit;
+		c.n_steps = exact.n_steps;
+		c.closest_target_distance = exact.target_hit ? 0.0f : exact.closest_target_distance;
+	}
+	std::stable_partition(ranked.begin(), ranked.end(), [](shot_candidate const& c) { return c.target_hit; });
+
+	shot_solver_result result;
+	result.n_candidates = n_simulated;
+	result.complete = n_simulated == n && !cancelled;
+	result.best_shots.assign(ranked.begin(), ranked.begin() + std::min(n_best, n_ranked));
+	result.reachable = !result.best_shots.empty() && result.best_shots[0].target_hit;
+	result.time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+	return result;
+}
+
+void shot_solver::start(Terrain const& terrain, simulation_parameters const& parameters, vec3 const& ball_position, vec3 const& target_position)
+{
+	cancel();
+	cancelled = false;
+	pending = std::async(std::launch::async, [this, &terrain, parameters, ball_position, target_position]() {
+		return solve(terrain, parameters, ball_position, target_position);
+	});
+}
+
+bool shot_solver::running() const
+{
+	return pending.valid();
+}
+
+bool shot_solver::poll(shot_solver_result& result)
+{
+	if (!pending.valid() || pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+		return false;
+	result = pending.get();
+	return true;
+}
+
+void shot_solver::cancel()
+{
+	if (!pending.valid())
+		return;
+	cancelled = true;
+	pending.wait();
+	pending = std::future<shot_solver_result>();
+}
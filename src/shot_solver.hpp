@@ -0,0 +1,72 @@
+#pragma once
+
+#include "simulation.hpp"
+
+#include <atomic>
+#include <future>
+#include <vector>
+
+// One kick, with the same parameters as the ones chosen in the game
+struct shot_candidate
+{
+	float angle_phi = 0.0f;
+	float angle_theta = 0.0f;
+	float force_strength = 0.0f;
+
+	bool target_hit = false;
+	int n_steps = 0;						// steps until the target is hit (or the ball stops)
+	float closest_target_distance = 0.0f;
+};
+
+struct shot_solver_result
+{
+	bool reachable = false;					// at least one candidate goes through the target
+	bool complete = false;					// every candidate of the grid was simulated, so a miss means that no shot of the grid reaches the target
+	std::vector<shot_candidate> best_shots;	// hits first (fastest first), then the closest misses
+	int n_candidates = 0;					// number of simulated candidates
+	double time = 0;						// in milliseconds
+};
+
+/** Search for the kicks that send the ball through the target.
+The candidates form a grid of (angle_phi, angle_theta, force_strength) covering the ranges of the game, searched coarse to fine:
+the sub-grid taking one candidate every coarse_phi x coarse_theta x coarse_strength is simulated first, then the full grid around the
+n_refined best coarse candidates (hits first, then the closest misses), which is about 8 times fewer simulations than the full grid.
+A hit of the pruned search is a real shot, but a miss is not a proof: the hits can lie between coarse candidates that all missed
+(complete is only true when the coarse spacings are 1 or the refined neighbourhoods cover the whole grid).
+The candidates are simulated with the rules of advance_ball and the step of the game (simulation_speed / physics_rate), until they stop:
+max_steps covers slow_stop_delay, from which a slow ball touching the ground is stopped, plus stop_margin.
+The states of the candidates are stored as arrays (one per coordinate), and each thread advances its band of moving candidates with
+advance_balls, so the heights and normals of the ground are evaluated for all of them at once with the batched evaluation.
+The batched heights only match the game within the float rounding, and the bounces amplify the differences: the n_verified best hits are
+replayed with ball_simulation, and a shot is only reported as a hit (and the target as reachable) when the replay hits too.
+solve() blocks; start() runs it on a separate thread and poll() returns the result once it is ready.
+The terrain must not be modified while a search is running (call cancel() first).	*/
+struct shot_solver
+{
+	int n_phi = 256;						// number of horizontal angles in [0, 2pi)
+	int n_theta = 12;						// number of vertical angles in [pi/6, pi/3]
+	int n_strength = 32;					// number of strengths in [0.3, 1.7]
+	int coarse_phi = 4;						// spacing of the coarse grid (in candidates of the full grid, 1 = no coarse pass)
+	int coarse_theta = 2;
+	int coarse_strength = 4;
+	int n_refined = 64;						// coarse candidates whose neighbourhood is simulated on the full grid
+	int n_best = 5;							// number of shots returned
+	int n_verified = 32;					// number of hits replayed with ball_simulation
+	float physics_rate = 60.0f;				// physics steps per second of the game (see scene_structure::physics_rate)
+	float stop_margin = 3.0f;				// seconds simulated after slow_stop_delay
+	int n_threads = 0;						// 0 = all the hardware threads
+
+	float time_step(simulation_parameters const& parameters) const;	// simulated time of a step, as in the game
+	int max_steps(simulation_parameters const& parameters) const;	// simulated steps per candidate
+
+	shot_solver_result solve(Terrain const& terrain, simulation_parameters const& parameters, vec3 const& ball_position, vec3 const& target_position) const;
+
+	void start(Terrain const& terrain, simulation_parameters const& parameters, vec3 const& ball_position, vec3 const& target_position);
+	bool running() const;
+	bool poll(shot_solver_result& result);	// true (and result filled) when a search started with start() is finished
+	void cancel();							// stop the running search (its result is dropped)
+
+private:
+	std::future<shot_solver_result> pending;
+	mutable std::atomic<bool> cancelled{false};
+};
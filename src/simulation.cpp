@@ -0,0 +1,408 @@
+#include "simulation.hpp"
+
+using namespace cgp;
+
+vec3 reflect(vec3 const& v, vec3 const& n)
+{
+	return v - 2 * n * dot(n, v);
+}
+
+float ball_clearance(vec3 const& center, terrain_sample const& ground, float r)
+{
+	// the ground is locally a plane: the bumps are several times wider than the ball
+	return (center.z - ground.height) * ground.normal.z - r;
+}
+
+float resting_height(terrain_sample const& ground, float r)
+{
+	return ground.height + r / ground.normal.z;
+}
+
+bool advance_ball(Terrain const& terrain, simulation_parameters const& p, vec3 const& target_position, ball_state& ball, float dt)
+{
+	if (!ball.moving)
+		return false;
+
+	float const r = p.ball_radius;
+
+	vec3 ball_force = p.ball_mass * vec3{0, 0, -p.gravity};
+	ball.velocity = ball.velocity + dt * ball_force / p.ball_mass;
+	ball.time_since_kick += dt / p.simulation_speed;
+
+	bool hit = false;
+
+	// distance between the ball and the ground (negative when the ball goes through it): distance from the center of the ball to the
+	// tangent plane of the ground under it, minus the radius (see ball_clearance)
+	auto clearance = [&terrain, r](vec3 const& q) { return ball_clearance(q, terrain.evaluate_terrain_sample(q.x, q.y), r); };
+
+	// swept collision: march along the segment of the step until the ball touches the ground,
+	// then refine the time of impact by bisection, bounce there and continue with the remaining time
+	float remaining = dt;
+	bool touched_ground = false;
+	vec3 normal = {0,0,1};
+
+	for (int contact = 0; contact < p.max_contacts && remaining > 0; contact++)
+	{
+		vec3 const start = ball.position;
+		vec3 const step = remaining * ball.velocity;
+
+		int const n_march = std::max(1, int(std::ceil(norm(step) / (p.collision_march_step * r))));
+		float t_free = 0.0f, t_hit = -1.0f;
+		if (clearance(start) <= 0)
+			t_hit = 0.0f;
+		for (int k = 1; k <= n_march && t_hit < 0; k++)
+		{
+			float t = float(k) / n_march;
+			if (clearance(start + t * step) <= 0)
+				t_hit = t;
+			else
+				t_free = t;
+		}
+
+		if (t_hit < 0)
+		{
+			hit = hit || segment_hits_target(p, target_position, start, start + step);
+			ball.position = start + step;
+			break;
+		}
+
+		// clearance(t_free) > 0 and clearance(t_hit) <= 0
+		if (t_hit > 0)
+		{
+			for (int k = 0; k < p.collision_bisections; k++)
+			{
+				float t = 0.5f * (t_free + t_hit);
+				if (clearance(start + t * step) <= 0)
+					t_hit = t;
+				else
+					t_free = t;
+			}
+		}
+
+		hit = hit || segment_hits_target(p, target_position, start, start + t_hit * step);
+		ball.position = start + t_hit * step;
+		remaining *= 1 - t_hit;
+
+		// height and exact normal of the ground at the contact (one evaluation)
+		terrain_sample ground = terrain.evaluate_terrain_sample(ball.position.x, ball.position.y);
+		normal = ground.normal;
+
+		// stay above the ground
+		ball.position.z = std::max(ball.position.z, resting_height(ground, r));
+
+		if (dot(ball.velocity, normal) < 0)
+		{
+			// we reached the ground: reflect towards the normal (and reduce the speed norm to lose energy)
+			ball.velocity = 0.8 * reflect(ball.velocity, normal);
+			touched_ground = true;
+		}
+		else
+		{
+			// already leaving the ground (e.g. climbing a slope): finish the step and stay above the ground
+			vec3 const end = ball.position + remaining * ball.velocity;
+			hit = hit || segment_hits_target(p, target_position, ball.position, end);
+			ball.position = end;
+			ball.position.z = std::max(ball.position.z, resting_height(terrain.evaluate_terrain_sample(end.x, end.y), r));
+			break;
+		}
+	}
+
+	if (touched_ground)
+	{
+		// we want the ball to slide down slopes reasonably fast, but not gain too much speed (otherwise, it falls with a constant & low speed)
+		// but also not enter infinite loops so we stop it after boost_duration
+		if (normal.z < 0.995 && norm(ball.velocity) < 3 && ball.time_since_kick < p.boost_duration)
+			ball.velocity = 1.3 * ball.velocity;
+
+		// after slow_stop_delay, we stop once it's slow enough (otherwise, it can get boring)
+		if (ball.time_since_kick > p.slow_stop_delay && norm(ball.velocity) < 0.5)
+			ball.velocity = {0,0,0};
+	}
+
+	return hit;
+}
+
+void ball_batch::resize(int n)
+{
+	px.resize(n); py.resize(n); pz.resize(n);
+	vx.resize(n); vy.resize(n); vz.resize(n);
+	time_since_kick.resize(n);
+}
+
+void ball_batch::set(int i, vec3 const& position, vec3 const& velocity)
+{
+	px[i] = position.x; py[i] = position.y; pz[i] = position.z;
+	vx[i] = velocity.x; vy[i] = velocity.y; vz[i] = velocity.z;
+}
+
+// Centers of the balls where the ground is evaluated by advance_balls, and the ground under them (one batched evaluation per stage)
+struct ground_queries
+{
+	std::vector<float> x, y, z;
+	std::vector<float> height, dz_dx, dz_dy;
+
+	void clear() { x.clear(); y.clear(); z.clear(); }
+	void add(vec3 const& q) { x.push_back(q.x); y.push_back(q.y); z.push_back(q.z); }
+	int size() const { return int(x.size()); }
+	void evaluate(Terrain const& terrain)
+	{
+		height.resize(x.size());
+		dz_dx.resize(x.size());
+		dz_dy.resize(x.size());
+		terrain.evaluate_terrain_sample_points(x.data(), y.data(), height.data(), dz_dx.data(), dz_dy.data(), size());
+	}
+	terrain_sample ground(int q) const
+	{
+		terrain_sample sample;
+		sample.height = height[q];
+		sample.gradient = {dz_dx[q], dz_dy[q]};
+		sample.normal = normalize(vec3{-dz_dx[q], -dz_dy[q], 1.0f});
+		return sample;
+	}
+	float clearance(int q, float r) const { return ball_clearance({x[q], y[q], z[q]}, ground(q), r); }
+};
+
+void advance_balls(Terrain const& terrain, simulation_parameters const& p, vec3 const& target_position, ball_batch& balls, int const* indices, int count, float dt, char* hit)
+{
+	float const r = p.ball_radius;
+	vec3 const ball_force = p.ball_mass * vec3{0, 0, -p.gravity};
+
+	// state of the collision of each ball during the step (see advance_ball)
+	std::vector<float> remaining(count, dt), t_free(count), t_hit(count);
+	std::vector<vec3> start(count), step(count), normal(count, vec3{0,0,1});
+	std::vector<char> touched_ground(count, 0);
+	std::vector<int> pending(count);		// balls still colliding (positions in indices)
+
+	for (int k = 0; k < count; k++)
+	{
+		int const i = indices[k];
+		balls.set(i, balls.position(i), balls.velocity(i) + dt * ball_force / p.ball_mass);
+		balls.time_since_kick[i] += dt / p.simulation_speed;
+		hit[k] = 0;
+		pending[k] = k;
+	}
+
+	ground_queries queries;
+	std::vector<int> first_query(count), n_march(count), contacts, leaving;
+
+	for (int contact = 0; contact < p.max_contacts && !pending.empty(); contact++)
+	{
+		// march: the start of the step, then the points along it, for all the balls
+		queries.clear();
+		for (int k : pending)
+		{
+			int const i = indices[k];
+			start[k] = balls.position(i);
+			step[k] = remaining[k] * balls.velocity(i);
+			n_march[k] = std::max(1, int(std::ceil(norm(step[k]) / (p.collision_march_step * r))));
+			first_query[k] = queries.size();
+			queries.add(start[k]);
+			for (int m = 1; m <= n_march[k]; m++)
+				queries.add(start[k] + (float(m) / n_march[k]) * step[k]);
+		}
+		queries.evaluate(terrain);
+
+		// first point below the ground; the balls that stay above finish their step
+		contacts.clear();
+		for (int k : pending)
+		{
+			int const i = indices[k];
+			t_free[k] = 0.0f;
+			t_hit[k] = -1.0f;
+			if (queries.clearance(first_query[k], r) <= 0)
+				t_hit[k] = 0.0f;
+			for (int m = 1; m <= n_march[k] && t_hit[k] < 0; m++)
+			{
+				float t = float(m) / n_march[k];
+				if (queries.clearance(first_query[k] + m, r) <= 0)
+					t_hit[k] = t;
+				else
+					t_free[k] = t;
+			}
+
+			if (t_hit[k] < 0)
+			{
+				hit[k] = hit[k] || segment_hits_target(p, target_position, start[k], start[k] + step[k]);
+				balls.set(i, start[k] + step[k], balls.velocity(i));
+			}
+			else
+				contacts.push_back(k);
+		}
+
+		// time of impact by bisection, one evaluation per iteration for all the balls
+		for (int b = 0; b < p.collision_bisections; b++)
+		{
+			queries.clear();
+			for (int k : contacts)
+				if (t_hit[k] > 0)
+					queries.add(start[k] + (0.5f * (t_free[k] + t_hit[k])) * step[k]);
+			if (queries.size() == 0)
+				break;
+			queries.evaluate(terrain);
+
+			int q = 0;
+			for (int k : contacts)
+			{
+				if (t_hit[k] <= 0)
+					continue;
+				float t = 0.5f * (t_free[k] + t_hit[k]);
+				if (queries.clearance(q++, r) <= 0)
+					t_hit[k] = t;
+				else
+					t_free[k] = t;
+			}
+		}
+
+		// height and exact normal of the ground at the contacts
+		queries.clear();
+		for (int k : contacts)
+		{
+			int const i = indices[k];
+			hit[k] = hit[k] || segment_hits_target(p, target_position, start[k], start[k] + t_hit[k] * step[k]);
+			balls.set(i, start[k] + t_hit[k] * step[k], balls.velocity(i));
+			remaining[k] *= 1 - t_hit[k];
+			queries.add(balls.position(i));
+		}
+		queries.evaluate(terrain);
+
+		pending.clear();
+		leaving.clear();
+		for (int q = 0; q < int(contacts.size()); q++)
+		{
+			int const k = contacts[q], i = indices[k];
+			terrain_sample const ground = queries.ground(q);
+			normal[k] = ground.normal;
+
+			vec3 position = balls.position(i);
+			vec3 velocity = balls.velocity(i);
+			position.z = std::max(position.z, resting_height(ground, r));
+
+			if (dot(velocity, normal[k]) < 0)
+			{
+				velocity = 0.8 * reflect(velocity, normal[k]);
+				touched_ground[k] = 1;
+				if (remaining[k] > 0)
+					pending.push_back(k);
+			}
+			else
+			{
+				// already leaving the ground: finish the step (the height at the end is evaluated below)
+				vec3 const end = position + remaining[k] * velocity;
+				hit[k] = hit[k] || segment_hits_target(p, target_position, position, end);
+				position = end;
+				leaving.push_back(k);
+			}
+			balls.set(i, position, velocity);
+		}
+
+		// the balls leaving the ground stay above it
+		queries.clear();
+		for (int k : leaving)
+			queries.add(balls.position(indices[k]));
+		queries.evaluate(terrain);
+		for (int q = 0; q < int(leaving.size()); q++)
+		{
+			int const i = indices[leaving[q]];
+			balls.pz[i] = std::max(balls.pz[i], resting_height(queries.ground(q), r));
+		}
+	}
+
+	for (int k = 0; k < count; k++)
+	{
+		if (!touched_ground[k])
+			continue;
+
+		int const i = indices[k];
+		vec3 velocity = balls.velocity(i);
+		if (normal[k].z < 0.995 && norm(velocity) < 3 && balls.time_since_kick[i] < p.boost_duration)
+			velocity = 1.3 * velocity;
+		if (balls.time_since_kick[i] > p.slow_stop_delay && norm(velocity) < 0.5)
+			velocity = {0,0,0};
+		balls.set(i, balls.position(i), velocity);
+	}
+}
+
+bool stop_ball(Terrain const& terrain, simulation_parameters const& parameters, ball_state& ball)
+{
+	if (!ball.moving || norm(ball.velocity) >= parameters.stop_threshold)
+		return false;
+
+	// near the ground: less than half a radius from its tangent plane, the ball is then put on it along the normal (as in the contacts)
+	float const r = parameters.ball_radius;
+	terrain_sample const ground = terrain.evaluate_terrain_sample(ball.position.x, ball.position.y);
+	if (ball_clearance(ball.position, ground, r) <= 0.5f * r)
+	{
+		ball.position.z = resting_height(ground, r);
+		ball.velocity = {0, 0, 0};
+		ball.moving = false;
+		return true;
+	}
+	return false;
+}
+
+bool ball_simulation::step(Terrain const& terrain, float dt)
+{
+	return advance_ball(terrain, parameters, target_position, ball, dt);
+}
+
+bool ball_simulation::try_stop(Terrain const& terrain)
+{
+	return stop_ball(terrain, parameters, ball);
+}
+
+bool ball_simulation::check_target_hit(vec3 const& old_pos, vec3 const& new_pos) const
+{
+	return segment_hits_target(parameters, target_position, old_pos, new_pos);
+}
+
+void ball_simulation::launch(vec3 const& direction, float strength)
+{
+	ball.velocity = direction * strength * parameters.force_coef;
+	ball.moving = true;
+	ball.time_since_kick = 0.0f;
+}
+
+void ball_simulation::reset(vec3 const& position, bool moving)
+{
+	ball.position = position;
+	ball.velocity = {0, 0, 0};
+	ball.moving = moving;
+	ball.time_since_kick = 0.0f;
+}
+
+bool segment_hits_target(simulation_parameters const& parameters, vec3 const& target_position, vec3 const& old_pos, vec3 const& new_pos)
+{
+	// recall that the target is always facing the y axis (that is, a {0,1,0} vector is going through the hole)
+
+	// first condition: we need to go from one side of the y plane to another, ie. the sign of (pos.y - target.y) has changed
+	if ((new_pos.y - target_position.y) * (old_pos.y - target_position.y) >= 0)
+		return false;
+
+	// then, we compute the position of the intersection point (pos.y == target.y)
+	vec3 intersection = old_pos + (new_pos - old_pos) * (target_position.y - old_pos.y) / (new_pos.y - old_pos.y);
+
+	// and we just have to check if the distance from the intersection point to the center of the target is <= the target radius
+	return norm(intersection - target_position) <= parameters.target_radius;
+}
+
+shot_result ball_simulation::simulate_shot(Terrain const& terrain, vec3 const& direction, float strength, float dt, int max_steps)
+{
+	shot_result result;
+	result.closest_target_distance = norm(ball.position - target_position);
+
+	launch(direction, strength);
+	while (ball.moving && result.n_steps < max_steps)
+	{
+		result.n_steps++;
+		if (step(terrain, dt))
+		{
+			result.target_hit = true;
+			break;
+		}
+		result.closest_target_distance = std::min(result.closest_target_distance, norm(ball.position - target_position));
+		try_stop(terrain);
+	}
+
+	result.final_position = ball.position;
+	return result;
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "terrain.hpp"
+
+using cgp::vec3;
+
+// Constants of the ball physics (the values the game was tuned with)
+struct simulation_parameters
+{
+	float ball_radius = 1.0f;
+	float ball_mass = 0.01f;
+	float gravity = 9.81f * 0.4f;			// gravity force (reduced)
+	float force_coef = 6;					// multiply the kick strength (shown visually) by this value
+	float stop_threshold = 0.2f;			// the ball stops when the norm of its speed is lower than this amount (near the ground)
+	float target_radius = 2.2f;				// the ball hits the target when it crosses its plane closer than this to its center
+
+	float simulation_speed = 6.0f;			// simulated time per second (the game was tuned with a step of 0.1 per frame at 60 fps)
+	float boost_duration = 5.0f;			// seconds after the kick during which the ball is accelerated on slopes
+	float slow_stop_delay = 10.0f;			// seconds after the kick from which a slow ball is stopped
+
+	// continuous collision with the terrain
+	float collision_march_step = 0.25f;		// distance between two tests along a step (relative to the ball radius)
+	int collision_bisections = 12;			// refinement iterations of the time of impact
+	int max_contacts = 5;					// maximal number of contacts resolved within one step (the remaining time is dropped beyond)
+};
+
+// State of the ball
+struct ball_state
+{
+	vec3 position = {0, 0, 0};
+	vec3 velocity = {0, 0, 0};
+	bool moving = true;						// false once the ball has stopped (until the next kick)
+	float time_since_kick = 0.0f;			// in seconds (simulated time / simulation_speed)
+};
+
+// Outcome of a shot simulated until the ball stops
+struct shot_result
+{
+	bool target_hit = false;
+	int n_steps = 0;
+	vec3 final_position = {0, 0, 0};
+	float closest_target_distance = 0.0f;	// smallest distance between the ball and the target center along the path
+};
+
+// Rules of the physics, shared by ball_simulation and the batched solvers
+// advance the ball by dt (simulated time), returns true if it went through the target during the step
+bool advance_ball(Terrain const& terrain, simulation_parameters const& parameters, vec3 const& target_position, ball_state& ball, float dt);
+// stop the ball if it is slow and near the ground, returns true if it just stopped
+bool stop_ball(Terrain const& terrain, simulation_parameters const& parameters, ball_state& ball);
+// whether the segment [old_pos, new_pos] goes through the target
+bool segment_hits_target(simulation_parameters const& parameters, vec3 const& target_position, vec3 const& old_pos, vec3 const& new_pos);
+// distance between a ball of radius r centered at center and the tangent plane of the ground sampled under it (negative when they intersect)
+// unlike the vertical gap, it sees the ball hitting a steep slope or a wall sideways
+float ball_clearance(vec3 const& center, terrain_sample const& ground, float r);
+// height of the center of a ball of radius r touching the tangent plane of the ground
+float resting_height(terrain_sample const& ground, float r);
+
+// States of many moving balls (structure of arrays), advanced together by advance_balls
+struct ball_batch
+{
+	std::vector<float> px, py, pz;
+	std::vector<float> vx, vy, vz;
+	std::vector<float> time_since_kick;
+
+	void resize(int n);
+	vec3 position(int i) const { return {px[i], py[i], pz[i]}; }
+	vec3 velocity(int i) const { return {vx[i], vy[i], vz[i]}; }
+	void set(int i, vec3 const& position, vec3 const& velocity);
+};
+
+/** advance_ball for the balls indices[0..count-1] of the batch (all moving), with the same rules.
+Each stage of the collision (march, bisection, contact) is done for all the balls at once: their heights and normals of the ground
+are evaluated together with evaluate_terrain_sample_points, which is exact up to the float rounding.
+hit[k] is set to whether the ball indices[k] went through the target during the step.	*/
+void advance_balls(Terrain const& terrain, simulation_parameters const& parameters, vec3 const& target_position, ball_batch& balls, int const* indices, int count, float dt, char* hit);
+
+/** Physics of the ball, independent from the rendering: it only needs the terrain.
+The scene owns one of these and draws its state; the headless tools run it directly.	*/
+struct ball_simulation
+{
+	simulation_parameters parameters;
+	ball_state ball;
+	vec3 target_position = {0, 0, 0};
+
+	// advance the ball by dt (simulated time), returns true if it went through the target during the step
+	bool step(Terrain const& terrain, float dt);
+	// stop the ball if it is slow and near the ground, returns true if it just stopped
+	bool try_stop(Terrain const& terrain);
+	// kick the ball in the given (unit) direction
+	void launch(vec3 const& direction, float strength);
+	// place the ball at rest (moving=false) or falling (moving=true) at the given position
+	void reset(vec3 const& position, bool moving);
+
+	// whether the segment [old_pos, new_pos] goes through the target
+	bool check_target_hit(vec3 const& old_pos, vec3 const& new_pos) const;
+
+	// kick the ball from its current position and simulate steps of dt until it stops, hits the target or max_steps is reached
+	shot_result simulate_shot(Terrain const& terrain, vec3 const& direction, float strength, float dt, int max_steps);
+};
+
+// reflection of v with respect to the plane of normal n
+vec3 reflect(vec3 const& v, vec3 const& n);
@@ -1,15 +1,47 @@
-
 #include "terrain.hpp"
+#include "parallel.hpp"
+
+#include <chrono>
 
 
 using namespace cgp;
 
-float Terrain::evaluate_terrain_height(float x, float y)
+float Terrain::evaluate_terrain_height(float x, float y) const
 {
 	// Evaluate z position of the terrain for any (x,y)
-	
-	float u = x / terrain_length + 0.5f, v = y / terrain_length + 0.5f;
+	return evaluate_bumps_height(x, y) + evaluate_walls_height(x, y);
+}
+
+float Terrain::evaluate_bumps_height(float x, float y) const
+{
+	// ignore the bumps beyond the cutoff of (x,y), with or without the index (only the bumps that can reach the cell of (x,y) are visited)
+	float const cutoff2 = bump_cutoff * bump_cutoff;
+	float z = 0.0f;
+
+	auto add_bump = [&](int i)
+	{
+		float dx = x - bump_x[i], dy = y - bump_y[i];
+		float t = (dx * dx + dy * dy) * bump_inv_s2[i];
+		if (t <= cutoff2)
+			z += bump_h[i] * std::exp(-t);
+	};
+
+	if (bump_grid_resolution == 0)
+	{
+		for (int i = 0; i < n_bumps; i++)
+			add_bump(i);
+		return z;
+	}
+
+	int cell = bump_cell_of(x, y);
+	for (int k = bump_cell_start[cell]; k < bump_cell_start[cell + 1]; k++)
+		add_bump(bump_cell_index[k]);
+
+	return z;
+}
 
+float Terrain::evaluate_bumps_height_brute_force(float x, float y) const
+{
 	float z = 0.0f;
 
 	for (int i = 0; i < n_bumps; i++)
@@ -18,61 +50,199 @@ float Terrain::evaluate_terrain_height(float x, float y)
 		z += h_i[i] * std::exp(-s*s);
 	}
 
+	return z;
+}
+
+float Terrain::evaluate_walls_height(float x, float y) const
+{
 	// add walls on the side
 
-	float min_car = min(cgp::numarray<float>{u, v, 1-u, 1-v});		// minimal distance to a side
+	float u = x / terrain_length + 0.5f, v = y / terrain_length + 0.5f;
 
-	z += 1 / (min_car + 0.01);			// very high near the side, low in the middle
+	float min_car = std::min(std::min(u, v), std::min(1-u, 1-v));		// minimal distance to a side
 
-	return z;
+	return 1 / (min_car + 0.01);			// very high near the side, low in the middle
 }
 
-void Terrain::update_positions()
+vec2 Terrain::evaluate_walls_gradient(float x, float y) const
 {
-	// compute the positions and connectivity
+	// walls: 1 / (m + 0.01) with m the distance to the closest side (in parametric coordinates)
+	float u = x / terrain_length + 0.5f, v = y / terrain_length + 0.5f;
+	float m = std::min(std::min(u, v), std::min(1-u, 1-v));
+	float wall = 1 / (m + 0.01f);
+	float dwall_dm = -wall * wall;
 
-	mesh.position.resize(N*N);
+	if (m == u)
+		return {dwall_dm / terrain_length, 0.0f};
+	else if (m == 1-u)
+		return {-dwall_dm / terrain_length, 0.0f};
+	else if (m == v)
+		return {0.0f, dwall_dm / terrain_length};
+	else
+		return {0.0f, -dwall_dm / terrain_length};
+}
+
+terrain_sample Terrain::evaluate_terrain_sample(float x, float y) const
+{
+	terrain_sample sample;
+	float z = 0.0f, dz_dx = 0.0f, dz_dy = 0.0f;
+
+	// bumps: h exp(-d^2/s^2), whose gradient is -2 (p - p_i) / s^2 * h exp(-d^2/s^2), with the cutoff of evaluate_bumps_height
+	float const cutoff2 = bump_cutoff * bump_cutoff;
+	auto add_bump = [&](int i)
+	{
+		float dx = x - bump_x[i], dy = y - bump_y[i];
+		float t = (dx * dx + dy * dy) * bump_inv_s2[i];
+		if (t > cutoff2)
+			return;
+		float c = bump_h[i] * std::exp(-t);
+		z += c;
+		dz_dx -= 2 * dx * bump_inv_s2[i] * c;
+		dz_dy -= 2 * dy * bump_inv_s2[i] * c;
+	};
+
+	if (bump_grid_resolution == 0)
+	{
+		for (int i = 0; i < n_bumps; i++)
+			add_bump(i);
+	}
+	else
+	{
+		// same bumps as evaluate_bumps_height
+		int cell = bump_cell_of(x, y);
+		for (int k = bump_cell_start[cell]; k < bump_cell_start[cell + 1]; k++)
+			add_bump(bump_cell_index[k]);
+	}
+
+	vec2 wall_gradient = evaluate_walls_gradient(x, y);
+	dz_dx += wall_gradient.x;
+	dz_dy += wall_gradient.y;
+
+	sample.height = z + evaluate_walls_height(x, y);
+	sample.gradient = {dz_dx, dz_dy};
+	sample.normal = normalize(vec3{-dz_dx, -dz_dy, 1.0f});
+
+	return sample;
+}
+
+// normal of the triangle (p0, p1, p2)
+static vec3 triangle_normal(vec3 const& p0, vec3 const& p1, vec3 const& p2)
+{
+	return normalize(cross(p1 - p0, p2 - p0));
+}
+
+void Terrain::compute_vertex_heights(int ku_begin, int ku_end, int kv_begin, int kv_end)
+{
+	int const n = kv_end - kv_begin;
+	std::vector<float> row_x(n), row_y(n), row_z(n);
 
-	// Fill terrain geometry
-	for(int ku=0; ku<N; ++ku)
+	for(int ku=ku_begin; ku<ku_end; ++ku)
 	{
-		for(int kv=0; kv<N; ++kv)
+		for(int kv=kv_begin; kv<kv_end; ++kv)
 		{
 			// Compute local parametric coordinates (u,v) \in [0,1]
 			float u = ku/(N-1.0f);
 			float v = kv/(N-1.0f);
 
 			// Compute the real coordinates (x,y) of the terrain in [-terrain_length/2, +terrain_length/2]
-			float x = (u - 0.5f) * terrain_length;
-			float y = (v - 0.5f) * terrain_length;
+			row_x[kv-kv_begin] = (u - 0.5f) * terrain_length;
+			row_y[kv-kv_begin] = (v - 0.5f) * terrain_length;
+		}
 
-			// Compute the surface height function at the given sampled coordinate
-			float z = evaluate_terrain_height(x,y);
+		// Compute the surface height function at the sampled coordinates of the row
+		evaluate_terrain_height_row(row_x.data(), row_y.data(), row_z.data(), n);
 
-			// Store vertex coordinates
-			mesh.position[kv+N*ku] = {x,y,z};
-			// mesh.uv[kv+N*ku] = {u * N_tex, v * N_tex};
-		}
+		// Store vertex coordinates
+		for(int kv=kv_begin; kv<kv_end; ++kv)
+			mesh.position[kv+N*ku] = {row_x[kv-kv_begin], row_y[kv-kv_begin], row_z[kv-kv_begin]};
 	}
+}
+
+vec3 Terrain::compute_vertex_normal(int ku, int kv) const
+{
+	// average of the normals of the (up to 6) adjacent triangles, always summed in the same order
+	numarray<vec3> const& p = mesh.position;
+	int idx = kv + N*ku;
+	vec3 n = {0, 0, 0};
+
+	if (ku < N-1 && kv < N-1)		// cell (ku, kv): both triangles
+		n += triangle_normal(p[idx], p[idx+1+N], p[idx+1]) + triangle_normal(p[idx], p[idx+N], p[idx+1+N]);
+	if (ku > 0 && kv < N-1)			// cell (ku-1, kv): second triangle
+		n += triangle_normal(p[idx-N], p[idx], p[idx+1]);
+	if (ku < N-1 && kv > 0)			// cell (ku, kv-1): first triangle
+		n += triangle_normal(p[idx-1], p[idx+N], p[idx]);
+	if (ku > 0 && kv > 0)			// cell (ku-1, kv-1): both triangles
+		n += triangle_normal(p[idx-1-N], p[idx], p[idx-N]) + triangle_normal(p[idx-1-N], p[idx-1], p[idx]);
+
+	return normalize(n);
+}
+
+void Terrain::update_positions()
+{
+	// compute the positions, connectivity and normals
+	// each stage is split in bands of rows (ku) processed in parallel, and writes directly in preallocated storage
+
+	using clock = std::chrono::steady_clock;
+	auto elapsed_ms = [](clock::time_point a, clock::time_point b) { return std::chrono::duration<double, std::milli>(b - a).count(); };
+
+	int const threads = parallel_thread_count(n_threads);
+	clock::time_point t0 = clock::now();
+
+	mesh.position.resize(N*N);
+	mesh.connectivity.resize(2*(N-1)*(N-1));
+	mesh.normal.resize(N*N);
+	mesh.color.resize(N*N);
+	mesh.uv.resize(N*N);
+
+	// Fill terrain geometry, one row (fixed ku) at a time with the batched evaluation
+	parallel_for_bands(N, threads, [this](int ku_begin, int ku_end)
+	{
+		compute_vertex_heights(ku_begin, ku_end, 0, N);
+	});
+	clock::time_point t1 = clock::now();
 
 	// Generate triangle organization
 	//  Parametric surface with uniform grid sampling: generate 2 triangles for each grid cell
-	for(int ku=0; ku<N-1; ++ku)
+	parallel_for_bands(N-1, threads, [this](int ku_begin, int ku_end)
 	{
-		for(int kv=0; kv<N-1; ++kv)
+		for(int ku=ku_begin; ku<ku_end; ++ku)
 		{
-			unsigned int idx = kv + N*ku; // current vertex offset
+			for(int kv=0; kv<N-1; ++kv)
+			{
+				unsigned int idx = kv + N*ku; // current vertex offset
+				int cell = kv + (N-1)*ku;
 
-			uint3 triangle_1 = {idx, idx+1+N, idx+1};
-			uint3 triangle_2 = {idx, idx+N, idx+1+N};
+				mesh.connectivity[2*cell]   = {idx, idx+1+N, idx+1};
+				mesh.connectivity[2*cell+1] = {idx, idx+N, idx+1+N};
+			}
+		}
+	});
+	clock::time_point t2 = clock::now();
 
-			mesh.connectivity.push_back(triangle_1);
-			mesh.connectivity.push_back(triangle_2);
+	// Per-vertex normals (and default colors/uv)
+	parallel_for_bands(N, threads, [this](int ku_begin, int ku_end)
+	{
+		for(int ku=ku_begin; ku<ku_end; ++ku)
+		{
+			for(int kv=0; kv<N; ++kv)
+			{
+				int idx = kv + N*ku;
+				mesh.normal[idx] = compute_vertex_normal(ku, kv);
+				mesh.color[idx] = {1, 1, 1};
+				mesh.uv[idx] = {0.0f, 0.0f};
+			}
 		}
-	}
+	});
+	clock::time_point t3 = clock::now();
 
-	// need to call this function to fill the other buffer with default values (normal, color, etc)
+	// fill the other buffers with default values if needed (all the sizes already match)
 	mesh.fill_empty_field(); 
+
+	build_timing.n_threads = threads;
+	build_timing.heights = elapsed_ms(t0, t1);
+	build_timing.indices = elapsed_ms(t1, t2);
+	build_timing.normals = elapsed_ms(t2, t3);
+	build_timing.total = elapsed_ms(t0, clock::now());
 }
 
 void Terrain::create_terrain_mesh(int N, float terrain_length, int n_bumps)
@@ -85,14 +255,136 @@ void Terrain::create_terrain_mesh(int N, float terrain_length, int n_bumps)
 	h_i.resize(n_bumps);
 	s_i.resize(n_bumps);
 
+	// the bump i only depends on the stream and i
 	for (int i = 0; i < n_bumps; i++)
 	{
-		p_i[i] = {(rand_uniform() - 0.5f) * terrain_length * 0.9, (rand_uniform() - 0.5f) * terrain_length * 0.9};
-		h_i[i] = rand_uniform(3.0f, 10.f);
-		s_i[i] = rand_uniform(3.0f, 15.0f);
+		std::array<uint32_t, 4> const r = random.bits(i);
+		p_i[i] = {(random_unit_float(r[0]) - 0.5f) * terrain_length * 0.9f, (random_unit_float(r[1]) - 0.5f) * terrain_length * 0.9f};
+		h_i[i] = random_float(r[2], 3.0f, 10.f);
+		s_i[i] = random_float(r[3], 3.0f, 15.0f);
 	}
-	
-	update_positions();
+
+	update_bump_arrays();
+	build_bump_index();
+
+	if (build_mesh)
+		update_positions();
+	else
+		mesh = cgp::mesh();
+
+	if (cache_resolution > 1)
+		build_height_cache(cache_resolution);
+	else
+	{
+		height_cache.clear();
+		cache_cell_error.clear();
+	}
+}
+
+terrain_region Terrain::add_bump(vec2 const& p, float h, float s)
+{
+	p_i.push_back(p);
+	h_i.push_back(h);
+	s_i.push_back(s);
+	n_bumps++;
+
+	update_bump_arrays();
+	build_bump_index();
+
+	float r = bump_cutoff * s;
+	return update_area(p.x - r, p.x + r, p.y - r, p.y + r);
+}
+
+terrain_region Terrain::move_bump(int i, vec2 const& p)
+{
+	assert_cgp(i >= 0 && i < n_bumps, "move_bump: no bump " + std::to_string(i) + " (" + std::to_string(n_bumps) + " bumps)");
+
+	// the area covers the old and the new support
+	float r = bump_cutoff * s_i[i];
+	float x_min = std::min(p.x, p_i[i].x) - r, x_max = std::max(p.x, p_i[i].x) + r;
+	float y_min = std::min(p.y, p_i[i].y) - r, y_max = std::max(p.y, p_i[i].y) + r;
+
+	p_i[i] = p;
+
+	update_bump_arrays();
+	build_bump_index();
+
+	return update_area(x_min, x_max, y_min, y_max);
+}
+
+terrain_region Terrain::remove_bump(int i)
+{
+	assert_cgp(i >= 0 && i < n_bumps, "remove_bump: no bump " + std::to_string(i) + " (" + std::to_string(n_bumps) + " bumps)");
+
+	float r = bump_cutoff * s_i[i];
+	vec2 p = p_i[i];
+
+	p_i.erase(p_i.begin() + i);
+	h_i.erase(h_i.begin() + i);
+	s_i.erase(s_i.begin() + i);
+	n_bumps--;
+
+	update_bump_arrays();
+	build_bump_index();
+
+	return update_area(p.x - r, p.x + r, p.y - r, p.y + r);
+}
+
+terrain_region Terrain::update_area(float x_min, float x_max, float y_min, float y_max)
+{
+	terrain_region region = {x_min, x_max, y_min, y_max, 0, -1, 0, -1};
+
+	// grid index range [k_min, k_max] of the samples in [a, b] for a grid of n samples
+	auto grid_range = [this](float a, float b, int n, int& k_min, int& k_max)
+	{
+		k_min = std::max(0, int(std::floor((a / terrain_length + 0.5f) * (n - 1))));
+		k_max = std::min(n - 1, int(std::ceil((b / terrain_length + 0.5f) * (n - 1))));
+	};
+
+	if (mesh.position.size() == size_t(N*N))
+	{
+		int ku_min, ku_max, kv_min, kv_max;
+		grid_range(x_min, x_max, N, ku_min, ku_max);
+		grid_range(y_min, y_max, N, kv_min, kv_max);
+
+		if (ku_min <= ku_max && kv_min <= kv_max)
+		{
+			compute_vertex_heights(ku_min, ku_max + 1, kv_min, kv_max + 1);
+
+			// the normals depend on the neighbour vertices
+			region.ku_min = std::max(ku_min - 1, 0);
+			region.ku_max = std::min(ku_max + 1, N - 1);
+			region.kv_min = std::max(kv_min - 1, 0);
+			region.kv_max = std::min(kv_max + 1, N - 1);
+
+			for (int ku = region.ku_min; ku <= region.ku_max; ku++)
+				for (int kv = region.kv_min; kv <= region.kv_max; kv++)
+					mesh.normal[kv + N*ku] = compute_vertex_normal(ku, kv);
+		}
+	}
+
+	if (!height_cache.empty())
+	{
+		int R = cache_resolution;
+		int cu_min, cu_max, cv_min, cv_max;
+		grid_range(x_min, x_max, R, cu_min, cu_max);
+		grid_range(y_min, y_max, R, cv_min, cv_max);
+
+		for (int ku = cu_min; ku <= cu_max; ku++)
+		{
+			for (int kv = cv_min; kv <= cv_max; kv++)
+			{
+				float x = (ku / (R - 1.0f) - 0.5f) * terrain_length;
+				float y = (kv / (R - 1.0f) - 0.5f) * terrain_length;
+				height_cache[kv + R * ku] = evaluate_bumps_height(x, y);
+			}
+		}
+
+		// the bicubic interpolation in the cell k uses the samples k-1 to k+2 (the errors of a loaded level are all measured on its first edit)
+		measure_cache_error(cu_min - 2, cu_max + 1, cv_min - 2, cv_max + 1);
+	}
+
+	return region;
 }
 
 vec3 Terrain::get_normal_from_position(int N, float length, float x, float y)
@@ -120,4 +412,212 @@ vec3 Terrain::get_normal_from_position(int N, float length, float x, float y)
 	}
 	
 	return mesh.normal[triangle_position];
-}
\ No newline at end of file
+}
+
+void Terrain::build_height_cache(int resolution)
+{
+	// sample the bumps on a regular grid (same parametrization as the mesh)
+
+	cache_resolution = resolution;
+	height_cache.resize(resolution * resolution);
+
+	for (int ku = 0; ku < resolution; ++ku)
+	{
+		for (int kv = 0; kv < resolution; ++kv)
+		{
+			float x = (ku / (resolution - 1.0f) - 0.5f) * terrain_length;
+			float y = (kv / (resolution - 1.0f) - 0.5f) * terrain_length;
+
+			height_cache[kv + resolution * ku] = evaluate_bumps_height(x, y);
+		}
+	}
+
+	cache_cell_error.clear();
+	measure_cache_error(0, resolution - 2, 0, resolution - 2);
+}
+
+void Terrain::measure_cache_error(int cu_min, int cu_max, int cv_min, int cv_max)
+{
+	// measure the interpolation error at the cell centers, where it is the largest
+	// (on a sub-grid of at most 128x128 cells to keep the build time reasonable)
+
+	int const R = cache_resolution;
+	int const step = std::max(1, (R - 1) / 128);
+	int const M = (R - 2) / step + 1;			// measured cells along one coordinate
+	float const cell = terrain_length / (R - 1.0f);
+
+	if (cache_error_step != step || int(cache_cell_error.size()) != M * M)
+	{
+		cache_error_step = step;
+		cache_cell_error.assign(M * M, 0.0f);
+		cu_min = cv_min = 0;
+		cu_max = cv_max = R - 2;
+	}
+
+	// measured cells (multiples of step) in the range
+	int const mu_min = std::max(0, (cu_min + step - 1) / step), mu_max = std::min(M - 1, cu_max / step);
+	int const mv_min = std::max(0, (cv_min + step - 1) / step), mv_max = std::min(M - 1, cv_max / step);
+
+	for (int mu = mu_min; mu <= mu_max; mu++)
+	{
+		for (int mv = mv_min; mv <= mv_max; mv++)
+		{
+			float x = (mu * step / (R - 1.0f) - 0.5f) * terrain_length + 0.5f * cell;
+			float y = (mv * step / (R - 1.0f) - 0.5f) * terrain_length + 0.5f * cell;
+
+			float cached = (cache_bicubic ? sample_height_bicubic(x, y) : sample_height_bilinear(x, y)) - evaluate_walls_height(x, y);
+			cache_cell_error[mv + M * mu] = std::abs(cached - evaluate_bumps_height(x, y));
+		}
+	}
+
+	cache_max_error = 0.0f;
+	for (float e : cache_cell_error)
+		cache_max_error = std::max(cache_max_error, e);
+}
+
+float Terrain::sample_height_bilinear(float x, float y) const
+{
+	int R = cache_resolution;
+	float u = (x / terrain_length + 0.5f) * (R - 1);
+	float v = (y / terrain_length + 0.5f) * (R - 1);
+
+	// outside the terrain: use the analytic function
+	if (u < 0 || v < 0 || u > R - 1 || v > R - 1)
+		return evaluate_terrain_height(x, y);
+
+	int ku = std::min(int(u), R - 2);
+	int kv = std::min(int(v), R - 2);
+	float a = u - ku, b = v - kv;
+
+	float const* c = &height_cache[kv + R * ku];
+	float z = (1 - a) * ((1 - b) * c[0] + b * c[1]) + a * ((1 - b) * c[R] + b * c[R + 1]);
+
+	return z + evaluate_walls_height(x, y);
+}
+
+// Catmull-Rom interpolation between p1 (t=0) and p2 (t=1)
+static float catmull_rom(float p0, float p1, float p2, float p3, float t)
+{
+	return p1 + 0.5f * t * (p2 - p0 + t * (2 * p0 - 5 * p1 + 4 * p2 - p3 + t * (3 * (p1 - p2) + p3 - p0)));
+}
+
+float Terrain::sample_height_bicubic(float x, float y) const
+{
+	int R = cache_resolution;
+	float u = (x / terrain_length + 0.5f) * (R - 1);
+	float v = (y / terrain_length + 0.5f) * (R - 1);
+
+	// outside the terrain: use the analytic function
+	if (u < 0 || v < 0 || u > R - 1 || v > R - 1)
+		return evaluate_terrain_height(x, y);
+
+	int ku = std::min(int(u), R - 2);
+	int kv = std::min(int(v), R - 2);
+	float a = u - ku, b = v - kv;
+
+	// interpolate the 4 rows along v, then the results along u
+	// (the samples outside the cache are linearly extrapolated to keep the accuracy near the sides)
+	float rows[4];
+	for (int i = 0; i < 4; i++)
+	{
+		int k = ku + i - 1;
+		if (k < 0 || k > R - 1)
+			continue;
+
+		float const* c = &height_cache[R * k];
+		float c0 = kv > 0 ? c[kv - 1] : 2 * c[kv] - c[kv + 1];
+		float c3 = kv + 2 < R ? c[kv + 2] : 2 * c[kv + 1] - c[kv];
+		rows[i] = catmull_rom(c0, c[kv], c[kv + 1], c3, b);
+	}
+	if (ku == 0)
+		rows[0] = 2 * rows[1] - rows[2];
+	if (ku + 2 > R - 1)
+		rows[3] = 2 * rows[2] - rows[1];
+
+	return catmull_rom(rows[0], rows[1], rows[2], rows[3], a) + evaluate_walls_height(x, y);
+}
+
+float Terrain::get_height(float x, float y) const
+{
+	if (height_cache.empty())
+		return evaluate_terrain_height(x, y);
+
+	return cache_bicubic ? sample_height_bicubic(x, y) : sample_height_bilinear(x, y);
+}
+
+int Terrain::bump_cell_of(float x, float y) const
+{
+	int R = bump_grid_resolution;
+	int cu = int((x / terrain_length + 0.5f) * R);
+	int cv = int((y / terrain_length + 0.5f) * R);
+
+	// points outside the grid use the closest cell: the bumps reaching them also reach this cell
+	cu = std::max(0, std::min(cu, R - 1));
+	cv = std::max(0, std::min(cv, R - 1));
+
+	return cv + R * cu;
+}
+
+void Terrain::build_bump_index()
+{
+	// about one bump center per cell
+	int R = std::max(1, std::min(128, int(std::ceil(std::sqrt(float(n_bumps))))));
+	float cell = terrain_length / R;
+
+	bump_grid_resolution = R;
+	bump_cell_start.assign(R * R + 1, 0);
+
+	// the cells overlapping the support disk of the bump i are given to f(cell)
+	auto for_each_cell = [&](int i, auto const& f)
+	{
+		float radius = bump_cutoff * s_i[i];
+		float px = bump_x[i], py = bump_y[i];
+
+		int cu_min = std::max(0, int(std::floor((px - radius) / cell + 0.5f * R)));
+		int cu_max = std::min(R - 1, int(std::floor((px + radius) / cell + 0.5f * R)));
+		int cv_min = std::max(0, int(std::floor((py - radius) / cell + 0.5f * R)));
+		int cv_max = std::min(R - 1, int(std::floor((py + radius) / cell + 0.5f * R)));
+
+		for (int cu = cu_min; cu <= cu_max; cu++)
+		{
+			for (int cv = cv_min; cv <= cv_max; cv++)
+			{
+				// distance between the bump center and the closest point of the cell
+				float x0 = (cu - 0.5f * R) * cell, y0 = (cv - 0.5f * R) * cell;
+				float dx = px - std::max(x0, std::min(px, x0 + cell));
+				float dy = py - std::max(y0, std::min(py, y0 + cell));
+
+				if (dx * dx + dy * dy <= radius * radius)
+					f(cv + R * cu);
+			}
+		}
+	};
+
+	// count the bumps of each cell, then fill the lists (bumps sorted by index in each cell)
+	for (int i = 0; i < n_bumps; i++)
+		for_each_cell(i, [&](int c) { bump_cell_start[c + 1]++; });
+
+	for (int c = 0; c < R * R; c++)
+		bump_cell_start[c + 1] += bump_cell_start[c];
+
+	bump_cell_index.resize(bump_cell_start[R * R]);
+	std::vector<int> fill(bump_cell_start.begin(), bump_cell_start.end() - 1);
+
+	for (int i = 0; i < n_bumps; i++)
+		for_each_cell(i, [&](int c) { bump_cell_index[fill[c]++] = i; });
+
+	// copies of the parameters, contiguous for each cell (read by the batched evaluation)
+	int const n_entries = int(bump_cell_index.size());
+	bump_cell_x.resize(n_entries);
+	bump_cell_y.resize(n_entries);
+	bump_cell_h.resize(n_entries);
+	bump_cell_inv_s2.resize(n_entries);
+	for (int k = 0; k < n_entries; k++)
+	{
+		int i = bump_cell_index[k];
+		bump_cell_x[k] = bump_x[i];
+		bump_cell_y[k] = bump_y[i];
+		bump_cell_h[k] = bump_h[i];
+		bump_cell_inv_s2[k] = bump_inv_s2[i];
+	}
+}
@@ -1,9 +1,39 @@
 #pragma once
 
 #include "cgp/cgp.hpp"
+#include "random.hpp"
 
 using cgp::vec2;
 
+// Time spent in each stage of the last call to Terrain::update_positions (in milliseconds)
+struct terrain_build_timing
+{
+	int n_threads = 1;
+	double heights = 0;		// height sampling
+	double indices = 0;		// triangle generation
+	double normals = 0;		// per-vertex normals (and default colors/uv)
+	double total = 0;
+};
+
+// Instruction set of the batched evaluation (batch_auto: the best one supported by the CPU)
+enum terrain_batch_isa { batch_auto, batch_avx2, batch_sse2, batch_scalar };
+
+// Height and slope of the terrain at a given (x,y)
+struct terrain_sample
+{
+	float height;
+	vec2 gradient;			// (dz/dx, dz/dy)
+	cgp::vec3 normal;		// unit normal of the surface, normalize(-dz/dx, -dz/dy, 1)
+};
+
+// Part of the terrain modified by an edit: the area [x_min, x_max] x [y_min, y_max],
+// and the mesh vertices whose position or normal changed (rows ku_min..ku_max, columns kv_min..kv_max)
+struct terrain_region
+{
+	float x_min, x_max, y_min, y_max;
+	int ku_min, ku_max, kv_min, kv_max;
+};
+
 struct Terrain
 {
 	int N, n_bumps;
@@ -13,17 +43,103 @@ struct Terrain
 	std::vector<float> h_i;			// heights of the bumps
 	std::vector<float> s_i;			// width of the bumps
 
+	// same bumps in a structure-of-arrays layout, used by the batched evaluation (filled by update_bump_arrays)
+	std::vector<float> bump_x, bump_y;	// positions of the bumps
+	std::vector<float> bump_h;			// heights of the bumps
+	std::vector<float> bump_inv_s2;		// 1 / s_i^2
+
+	// Uniform grid over [-length/2, length/2]^2 indexing the bumps (built in create_terrain_mesh by build_bump_index).
+	// A bump is ignored at the points beyond bump_cutoff * s_i of its center, so each cell lists the bumps whose support disk overlaps it
+	// (the queries test the cutoff point by point, so the result does not depend on the grid, and the cutoff also applies without the index).
+	// The error of a query is at most sum(h_i) * exp(-bump_cutoff^2) over the ignored bumps (~5e-5 per bump for the default 3.5),
+	// plus the float rounding of the sum (checked against evaluate_bumps_height_brute_force by headless --check).
+	float bump_cutoff = 3.5f;
+	int bump_grid_resolution = 0;		// number of cells along one coordinate (0 = no index)
+	std::vector<int> bump_cell_start;	// bumps of the cell c are bump_cell_index[bump_cell_start[c] .. bump_cell_start[c+1]-1]
+	std::vector<int> bump_cell_index;
+	std::vector<float> bump_cell_x, bump_cell_y, bump_cell_h, bump_cell_inv_s2;	// parameters of the bumps in the order of bump_cell_index
+
 	cgp::mesh mesh;
 
-	float evaluate_terrain_height(float x, float y);
+	random_stream random;				// stream of the bumps drawn by create_terrain_mesh: the same stream gives the same terrain
+	bool build_mesh = true;				// if false, create_terrain_mesh only generates the bumps (e.g. when the terrain is drawn with tiles)
+	int n_threads = 0;					// number of threads used to build the mesh (0 = number of hardware threads)
+	terrain_build_timing build_timing;	// timings of the last mesh build
+
+	// Optional heightfield cache (built in create_terrain_mesh when cache_resolution > 1).
+	// Only the sum of the bumps is cached: the walls are steep near the sides and cheap to evaluate,
+	// so they are always added analytically. The cache covers [-length/2, length/2]^2.
+	int cache_resolution = 512;			// number of cache samples along one coordinate (<= 1 = no cache: one sample cannot be interpolated)
+	bool cache_bicubic = true;			// Catmull-Rom interpolation if true, bilinear otherwise
+	std::vector<float> height_cache;	// bumps height at the cache samples (index kv + cache_resolution * ku)
+	float cache_max_error = 0.0f;		// maximal |cached - analytic| height measured at the cell centers (kept up to date by the edits)
+	std::vector<float> cache_cell_error;	// error measured at the center of every cache_error_step-th cell along each coordinate
+	int cache_error_step = 1;
+										// (with the default scene and resolution: ~1e-3 for bicubic, ~1e-2 for bilinear)
+
+	float evaluate_terrain_height(float x, float y) const;
+	float evaluate_bumps_height(float x, float y) const;				// uses the bump index when it is built
+	float evaluate_bumps_height_brute_force(float x, float y) const;	// sum over all the bumps, without the cutoff (reference of the truncation error)
+	float evaluate_walls_height(float x, float y) const;
+	vec2 evaluate_walls_gradient(float x, float y) const;
+
+	// Exact height, gradient and normal in a single pass over the (indexed) bumps and the walls
+	terrain_sample evaluate_terrain_sample(float x, float y) const;
+
+	/** Batched evaluation (see terrain_batch.cpp)
+	evaluate_terrain_height_row computes z[k] = evaluate_terrain_height(x[k], y[k]) for k < count.
+	Only the bumps whose support (see bump_cutoff) overlaps the bounding box of the points are evaluated, with the same per-point cutoff.
+	It uses AVX2 or SSE2 when the CPU supports them (with a polynomial exp), and a scalar loop otherwise;
+	the heights match evaluate_terrain_height within a relative error of 1e-5 (checked by headless --check, for every instruction set).
+	evaluate_terrain_height_points does the same for scattered points (e.g. the balls of a batched simulation): they are grouped by
+	cell of the bump index, and the points of a cell are evaluated like a row with the bumps of the cell.
+	evaluate_terrain_sample_points also computes the gradients, as evaluate_terrain_sample.
+	update_bump_arrays (then build_bump_index) must be called after any modification of p_i, h_i, s_i.	*/
+
+	void update_bump_arrays();
+	void build_bump_index();
+	int bump_cell_of(float x, float y) const;		// cell containing (x,y) (clamped to the grid)
+	void evaluate_terrain_height_row(float const* x, float const* y, float* z, int count, terrain_batch_isa isa = batch_auto) const;
+	void evaluate_terrain_height_points(float const* x, float const* y, float* z, int count) const;
+	void evaluate_terrain_sample_points(float const* x, float const* y, float* z, float* dz_dx, float* dz_dy, int count) const;
+	static bool batch_isa_supported(terrain_batch_isa isa);		// whether the instruction set is compiled in and supported by the CPU
 
 	/** Compute a terrain mesh 
 	The (x,y) coordinates of the terrain are set in [-length/2, length/2].
 	The z coordinates of the vertices are computed using evaluate_terrain_height(x,y).
 	The vertices are sampled along a regular grid structure in (x,y) directions. 
-	The total number of vertices is N*N (N along each direction x/y) 	*/
+	The total number of vertices is N*N (N along each direction x/y)
+	The mesh is built in row bands on n_threads threads (heights, triangles, then normals),
+	and the result does not depend on the number of threads.	*/
 
 	void update_positions();
 	void create_terrain_mesh(int N, float length, int n_bumps);
 	cgp::vec3 get_normal_from_position(int N, float length, float x, float y);
-};
\ No newline at end of file
+
+	void compute_vertex_heights(int ku_begin, int ku_end, int kv_begin, int kv_end);	// positions of the vertices of the given rows/columns (end excluded)
+	cgp::vec3 compute_vertex_normal(int ku, int kv) const;								// normal of a vertex from its adjacent triangles
+
+	/** Terrain edition
+	Each function modifies one bump, then only recomputes what is inside the support of the old/new bump:
+	the mesh positions, the normals (one more vertex around), and the height cache samples.
+	The returned region gives the vertices to send to the GPU (rows of the mesh are contiguous in the buffers).
+	The interpolation error of the cache is measured again on the cells whose interpolation uses the new samples, and cache_max_error updated.
+	The index i of move_bump and remove_bump must be in [0, n_bumps).
+	The bump arrays and index are rebuilt, which costs O(n_bumps) but no evaluation of the terrain.	*/
+
+	terrain_region add_bump(vec2 const& p, float h, float s);
+	terrain_region move_bump(int i, vec2 const& p);
+	terrain_region remove_bump(int i);
+	terrain_region update_area(float x_min, float x_max, float y_min, float y_max);
+
+	/** Heightfield cache
+	build_height_cache samples the bumps on a resolution*resolution grid, then measures the interpolation error.
+	The sampling functions cost O(1) whatever the number of bumps, and fall back to the analytic function outside the terrain.
+	get_height is the query to use in the per-frame code: it uses the cache when it is available.	*/
+
+	void build_height_cache(int resolution);
+	void measure_cache_error(int cu_min, int cu_max, int cv_min, int cv_max);	// measured cells in [cu_min, cu_max] x [cv_min, cv_max], then the max
+	float sample_height_bilinear(float x, float y) const;
+	float sample_height_bicubic(float x, float y) const;
+	float get_height(float x, float y) const;
+};
@@ -0,0 +1,518 @@
+#include "terrain.hpp"
+
+// Batched evaluation of the terrain height.
+// The bumps are stored in a structure-of-arrays layout, and the points are processed 8 (AVX2) or 4 (SSE2) at a time:
+// for each bump reaching the row, its parameters are broadcast and the contributions of all the points are accumulated in registers.
+// std::exp is replaced by a polynomial approximation (range reduction to [-ln2/2, ln2/2], Cephes coefficients).
+// The AVX2 version is compiled with a target attribute and selected at runtime, so no specific compiler flag is needed.
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__)
+#define TERRAIN_BATCH_SSE2
+#include <immintrin.h>
+#if defined(__GNUC__) || defined(__clang__)
+#define TERRAIN_BATCH_AVX2
+#define TERRAIN_BATCH_AVX2_TARGET __attribute__((target("avx2,fma")))
+#elif defined(__AVX2__)
+#define TERRAIN_BATCH_AVX2
+#define TERRAIN_BATCH_AVX2_TARGET
+#endif
+#endif
+
+using namespace cgp;
+
+void Terrain::update_bump_arrays()
+{
+	bump_x.resize(n_bumps);
+	bump_y.resize(n_bumps);
+	bump_h.resize(n_bumps);
+	bump_inv_s2.resize(n_bumps);
+
+	for (int i = 0; i < n_bumps; i++)
+	{
+		bump_x[i] = p_i[i].x;
+		bump_y[i] = p_i[i].y;
+		bump_h[i] = h_i[i];
+		bump_inv_s2[i] = 1.0f / (s_i[i] * s_i[i]);
+	}
+}
+
+
+// Bumps evaluated by the kernels (structure-of-arrays, pointing to the gathered bumps of a row or to the bumps of a cell)
+// As in evaluate_bumps_height, a bump only contributes to the points where d^2/s^2 <= cutoff2
+struct bump_set
+{
+	float const* x = nullptr;
+	float const* y = nullptr;
+	float const* h = nullptr;
+	float const* inv_s2 = nullptr;
+	int n = 0;
+	float cutoff2 = 0;
+	int size() const { return n; }
+};
+
+// Scalar version (also used for the remaining points of a row)
+static void evaluate_row_scalar(Terrain const& terrain, bump_set const& bumps, float const* x, float const* y, float* z, int count)
+{
+	for (int k = 0; k < count; k++)
+	{
+		float sum = 0.0f;
+		for (int i = 0; i < bumps.size(); i++)
+		{
+			float dx = x[k] - bumps.x[i], dy = y[k] - bumps.y[i];
+			float t = (dx * dx + dy * dy) * bumps.inv_s2[i];
+			if (t <= bumps.cutoff2)
+				sum += bumps.h[i] * std::exp(-t);
+		}
+		z[k] = sum + terrain.evaluate_walls_height(x[k], y[k]);
+	}
+}
+
+// Height and gradient of the bumps (the walls are added by the caller)
+static void evaluate_sample_scalar(bump_set const& bumps, float const* x, float const* y, float* z, float* dz_dx, float* dz_dy, int count)
+{
+	for (int k = 0; k < count; k++)
+	{
+		float sum = 0.0f, gx = 0.0f, gy = 0.0f;
+		for (int i = 0; i < bumps.size(); i++)
+		{
+			float dx = x[k] - bumps.x[i], dy = y[k] - bumps.y[i];
+			float t = (dx * dx + dy * dy) * bumps.inv_s2[i];
+			if (t <= bumps.cutoff2)
+			{
+				float c = bumps.h[i] * std::exp(-t);
+				sum += c;
+				gx -= 2 * dx * bumps.inv_s2[i] * c;
+				gy -= 2 * dy * bumps.inv_s2[i] * c;
+			}
+		}
+		z[k] = sum;
+		dz_dx[k] = gx;
+		dz_dy[k] = gy;
+	}
+}
+
+
+#ifdef TERRAIN_BATCH_SSE2
+
+// exp(t) for t <= 0 (values below -87 return ~0)
+static inline __m128 exp_negative_sse2(__m128 t)
+{
+	t = _mm_max_ps(t, _mm_set1_ps(-87.0f));
+
+	// t = n ln2 + r with |r| <= ln2/2
+	__m128i n = _mm_cvtps_epi32(_mm_mul_ps(t, _mm_set1_ps(1.44269504f)));
+	__m128 nf = _mm_cvtepi32_ps(n);
+	__m128 r = _mm_sub_ps(t, _mm_mul_ps(nf, _mm_set1_ps(0.693359375f)));
+	r = _mm_add_ps(r, _mm_mul_ps(nf, _mm_set1_ps(2.12194440e-4f)));
+
+	__m128 p = _mm_set1_ps(1.9875691500e-4f);
+	p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(1.3981999507e-3f));
+	p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(8.3334519073e-3f));
+	p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(4.1665795894e-2f));
+	p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(1.6666665459e-1f));
+	p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(5.0000001201e-1f));
+	p = _mm_add_ps(_mm_mul_ps(p, _mm_mul_ps(r, r)), _mm_add_ps(r, _mm_set1_ps(1.0f)));
+
+	// multiply by 2^n (built directly in the exponent bits)
+	__m128i e = _mm_slli_epi32(_mm_add_epi32(n, _mm_set1_epi32(127)), 23);
+	return _mm_mul_ps(p, _mm_castsi128_ps(e));
+}
+
+// walls term of evaluate_walls_height
+static inline __m128 walls_sse2(__m128 x, __m128 y, float terrain_length)
+{
+	__m128 inv_length = _mm_set1_ps(1.0f / terrain_length);
+	__m128 half = _mm_set1_ps(0.5f);
+	__m128 u = _mm_add_ps(_mm_mul_ps(x, inv_length), half);
+	__m128 v = _mm_add_ps(_mm_mul_ps(y, inv_length), half);
+	__m128 one = _mm_set1_ps(1.0f);
+
+	__m128 m = _mm_min_ps(_mm_min_ps(u, v), _mm_min_ps(_mm_sub_ps(one, u), _mm_sub_ps(one, v)));
+	return _mm_div_ps(one, _mm_add_ps(m, _mm_set1_ps(0.01f)));
+}
+
+static int evaluate_row_sse2(Terrain const& terrain, bump_set const& bumps, float const* x, float const* y, float* z, int count)
+{
+	__m128 const min_t = _mm_set1_ps(-bumps.cutoff2);
+
+	int k = 0;
+	for (; k + 4 <= count; k += 4)
+	{
+		__m128 px = _mm_loadu_ps(x + k), py = _mm_loadu_ps(y + k);
+		__m128 sum = _mm_setzero_ps();
+
+		for (int i = 0; i < bumps.size(); i++)
+		{
+			__m128 dx = _mm_sub_ps(px, _mm_set1_ps(bumps.x[i]));
+			__m128 dy = _mm_sub_ps(py, _mm_set1_ps(bumps.y[i]));
+			__m128 d2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+			__m128 t = _mm_mul_ps(d2, _mm_set1_ps(-bumps.inv_s2[i]));
+			__m128 inside = _mm_cmpge_ps(t, min_t);
+			sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(bumps.h[i]), _mm_and_ps(inside, exp_negative_sse2(t))));
+		}
+
+		_mm_storeu_ps(z + k, _mm_add_ps(sum, walls_sse2(px, py, terrain.terrain_length)));
+	}
+	return k;
+}
+
+// gradient of h exp(-d^2/s^2): -2 (p - p_i) / s^2 * h exp(-d^2/s^2)
+static int evaluate_sample_sse2(bump_set const& bumps, float const* x, float const* y, float* z, float* dz_dx, float* dz_dy, int count)
+{
+	__m128 const min_t = _mm_set1_ps(-bumps.cutoff2);
+
+	int k = 0;
+	for (; k + 4 <= count; k += 4)
+	{
+		__m128 px = _mm_loadu_ps(x + k), py = _mm_loadu_ps(y + k);
+		__m128 sum = _mm_setzero_ps(), gx = _mm_setzero_ps(), gy = _mm_setzero_ps();
+
+		for (int i = 0; i < bumps.size(); i++)
+		{
+			__m128 dx = _mm_sub_ps(px, _mm_set1_ps(bumps.x[i]));
+			__m128 dy = _mm_sub_ps(py, _mm_set1_ps(bumps.y[i]));
+			__m128 d2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+			__m128 t = _mm_mul_ps(d2, _mm_set1_ps(-bumps.inv_s2[i]));
+			__m128 inside = _mm_cmpge_ps(t, min_t);
+			__m128 c = _mm_mul_ps(_mm_set1_ps(bumps.h[i]), _mm_and_ps(inside, exp_negative_sse2(t)));
+			__m128 w = _mm_mul_ps(c, _mm_set1_ps(-2 * bumps.inv_s2[i]));
+			sum = _mm_add_ps(sum, c);
+			gx = _mm_add_ps(gx, _mm_mul_ps(dx, w));
+			gy = _mm_add_ps(gy, _mm_mul_ps(dy, w));
+		}
+
+		_mm_storeu_ps(z + k, sum);
+		_mm_storeu_ps(dz_dx + k, gx);
+		_mm_storeu_ps(dz_dy + k, gy);
+	}
+	return k;
+}
+
+#endif
+
+
+#ifdef TERRAIN_BATCH_AVX2
+
+TERRAIN_BATCH_AVX2_TARGET
+static inline __m256 exp_negative_avx2(__m256 t)
+{
+	t = _mm256_max_ps(t, _mm256_set1_ps(-87.0f));
+
+	__m256 nf = _mm256_round_ps(_mm256_mul_ps(t, _mm256_set1_ps(1.44269504f)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+	__m256 r = _mm256_fnmadd_ps(nf, _mm256_set1_ps(0.693359375f), t);
+	r = _mm256_fmadd_ps(nf, _mm256_set1_ps(2.12194440e-4f), r);
+
+	__m256 p = _mm256_set1_ps(1.9875691500e-4f);
+	p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.3981999507e-3f));
+	p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(8.3334519073e-3f));
+	p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(4.1665795894e-2f));
+	p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.6666665459e-1f));
+	p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(5.0000001201e-1f));
+	p = _mm256_fmadd_ps(p, _mm256_mul_ps(r, r), _mm256_add_ps(r, _mm256_set1_ps(1.0f)));
+
+	__m256i e = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(nf), _mm256_set1_epi32(127)), 23);
+	return _mm256_mul_ps(p, _mm256_castsi256_ps(e));
+}
+
+TERRAIN_BATCH_AVX2_TARGET
+static inline __m256 walls_avx2(__m256 x, __m256 y, float terrain_length)
+{
+	__m256 inv_length = _mm256_set1_ps(1.0f / terrain_length);
+	__m256 half = _mm256_set1_ps(0.5f);
+	__m256 u = _mm256_fmadd_ps(x, inv_length, half);
+	__m256 v = _mm256_fmadd_ps(y, inv_length, half);
+	__m256 one = _mm256_set1_ps(1.0f);
+
+	__m256 m = _mm256_min_ps(_mm256_min_ps(u, v), _mm256_min_ps(_mm256_sub_ps(one, u), _mm256_sub_ps(one, v)));
+	return _mm256_div_ps(one, _mm256_add_ps(m, _mm256_set1_ps(0.01f)));
+}
+
+TERRAIN_BATCH_AVX2_TARGET
+static int evaluate_row_avx2(Terrain const& terrain, bump_set const& bumps, float const* x, float const* y, float* z, int count)
+{
+	__m256 const min_t = _mm256_set1_ps(-bumps.cutoff2);
+
+	int k = 0;
+	for (; k + 8 <= count; k += 8)
+	{
+		__m256 px = _mm256_loadu_ps(x + k), py = _mm256_loadu_ps(y + k);
+		__m256 sum = _mm256_setzero_ps();
+
+		for (int i = 0; i < bumps.size(); i++)
+		{
+			__m256 dx = _mm256_sub_ps(px, _mm256_set1_ps(bumps.x[i]));
+			__m256 dy = _mm256_sub_ps(py, _mm256_set1_ps(bumps.y[i]));
+			__m256 d2 = _mm256_fmadd_ps(dx, dx, _mm256_mul_ps(dy, dy));
+			__m256 t = _mm256_mul_ps(d2, _mm256_set1_ps(-bumps.inv_s2[i]));
+			__m256 inside = _mm256_cmp_ps(t, min_t, _CMP_GE_OQ);
+			sum = _mm256_fmadd_ps(_mm256_set1_ps(bumps.h[i]), _mm256_and_ps(inside, exp_negative_avx2(t)), sum);
+		}
+
+		_mm256_storeu_ps(z + k, _mm256_add_ps(sum, walls_avx2(px, py, terrain.terrain_length)));
+	}
+	return k;
+}
+
+TERRAIN_BATCH_AVX2_TARGET
+static int evaluate_sample_avx2(bump_set const& bumps, float const* x, float const* y, float* z, float* dz_dx, float* dz_dy, int count)
+{
+	__m256 const min_t = _mm256_set1_ps(-bumps.cutoff2);
+
+	int k = 0;
+	for (; k + 8 <= count; k += 8)
+	{
+		__m256 px = _mm256_loadu_ps(x + k), py = _mm256_loadu_ps(y + k);
+		__m256 sum = _mm256_setzero_ps(), gx = _mm256_setzero_ps(), gy = _mm256_setzero_ps();
+
+		for (int i = 0; i < bumps.size(); i++)
+		{
+			__m256 dx = _mm256_sub_ps(px, _mm256_set1_ps(bumps.x[i]));
+			__m256 dy = _mm256_sub_ps(py, _mm256_set1_ps(bumps.y[i]));
+			__m256 d2 = _mm256_fmadd_ps(dx, dx, _mm256_mul_ps(dy, dy));
+			__m256 t = _mm256_mul_ps(d2, _mm256_set1_ps(-bumps.inv_s2[i]));
+			__m256 inside = _mm256_cmp_ps(t, min_t, _CMP_GE_OQ);
+			__m256 c = _mm256_mul_ps(_mm256_set1_ps(bumps.h[i]), _mm256_and_ps(inside, exp_negative_avx2(t)));
+			__m256 w = _mm256_mul_ps(c, _mm256_set1_ps(-2 * bumps.inv_s2[i]));
+			sum = _mm256_add_ps(sum, c);
+			gx = _mm256_fmadd_ps(dx, w, gx);
+			gy = _mm256_fmadd_ps(dy, w, gy);
+		}
+
+		_mm256_storeu_ps(z + k, sum);
+		_mm256_storeu_ps(dz_dx + k, gx);
+		_mm256_storeu_ps(dz_dy + k, gy);
+	}
+	return k;
+}
+
+static bool cpu_has_avx2()
+{
+#if defined(__GNUC__) || defined(__clang__)
+	static bool const supported = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+	return supported;
+#else
+	return true;	// only compiled when __AVX2__ is defined
+#endif
+}
+
+#endif
+
+
+bool Terrain::batch_isa_supported(terrain_batch_isa isa)
+{
+	switch (isa)
+	{
+#if defined(TERRAIN_BATCH_AVX2)
+	case batch_avx2: return cpu_has_avx2();
+#endif
+#if defined(TERRAIN_BATCH_SSE2)
+	case batch_sse2: return true;
+#endif
+	case batch_auto:
+	case batch_scalar: return true;
+	default: return false;
+	}
+}
+
+static terrain_batch_isa resolve_isa(terrain_batch_isa isa)
+{
+	if (isa == batch_auto || !Terrain::batch_isa_supported(isa))
+		isa = Terrain::batch_isa_supported(batch_avx2) ? batch_avx2 : Terrain::batch_isa_supported(batch_sse2) ? batch_sse2 : batch_scalar;
+	return isa;
+}
+
+// heights of the points (bumps of the set and walls)
+static void evaluate_row(Terrain const& terrain, bump_set const& bumps, float const* x, float const* y, float* z, int count, terrain_batch_isa isa)
+{
+	int k = 0;
+
+#if defined(TERRAIN_BATCH_AVX2)
+	if (isa == batch_avx2)
+		k = evaluate_row_avx2(terrain, bumps, x, y, z, count);
+#endif
+#if defined(TERRAIN_BATCH_SSE2)
+	if (isa == batch_sse2)
+		k = evaluate_row_sse2(terrain, bumps, x, y, z, count);
+#endif
+
+	// remaining points (or all of them without SIMD support)
+	evaluate_row_scalar(terrain, bumps, x + k, y + k, z + k, count - k);
+}
+
+// heights and gradients of the points (bumps of the set and walls)
+static void evaluate_sample_row(Terrain const& terrain, bump_set const& bumps, float const* x, float const* y, float* z, float* dz_dx, float* dz_dy, int count, terrain_batch_isa isa)
+{
+	int k = 0;
+
+#if defined(TERRAIN_BATCH_AVX2)
+	if (isa == batch_avx2)
+		k = evaluate_sample_avx2(bumps, x, y, z, dz_dx, dz_dy, count);
+#endif
+#if defined(TERRAIN_BATCH_SSE2)
+	if (isa == batch_sse2)
+		k = evaluate_sample_sse2(bumps, x, y, z, dz_dx, dz_dy, count);
+#endif
+
+	evaluate_sample_scalar(bumps, x + k, y + k, z + k, dz_dx + k, dz_dy + k, count - k);
+
+	// the walls are cheap and branchy (the closest side): evaluated one point at a time
+	for (k = 0; k < count; k++)
+	{
+		vec2 gradient = terrain.evaluate_walls_gradient(x[k], y[k]);
+		z[k] += terrain.evaluate_walls_height(x[k], y[k]);
+		dz_dx[k] += gradient.x;
+		dz_dy[k] += gradient.y;
+	}
+}
+
+void Terrain::evaluate_terrain_height_row(float const* x, float const* y, float* z, int count, terrain_batch_isa isa) const
+{
+	if (count <= 0)
+		return;
+
+	// gather the bumps whose support overlaps the bounding box of the points
+	float x_min = *std::min_element(x, x + count), x_max = *std::max_element(x, x + count);
+	float y_min = *std::min_element(y, y + count), y_max = *std::max_element(y, y + count);
+
+	std::vector<float> gathered_x, gathered_y, gathered_h, gathered_inv_s2;
+	gathered_x.reserve(n_bumps);
+	gathered_y.reserve(n_bumps);
+	gathered_h.reserve(n_bumps);
+	gathered_inv_s2.reserve(n_bumps);
+	for (int i = 0; i < n_bumps; i++)
+	{
+		float dx = bump_x[i] - std::max(x_min, std::min(bump_x[i], x_max));
+		float dy = bump_y[i] - std::max(y_min, std::min(bump_y[i], y_max));
+		float radius = bump_cutoff * s_i[i];
+
+		if (dx * dx + dy * dy <= radius * radius)
+		{
+			gathered_x.push_back(bump_x[i]);
+			gathered_y.push_back(bump_y[i]);
+			gathered_h.push_back(bump_h[i]);
+			gathered_inv_s2.push_back(bump_inv_s2[i]);
+		}
+	}
+
+	bump_set bumps;
+	bumps.x = gathered_x.data();
+	bumps.y = gathered_y.data();
+	bumps.h = gathered_h.data();
+	bumps.inv_s2 = gathered_inv_s2.data();
+	bumps.n = int(gathered_x.size());
+	bumps.cutoff2 = bump_cutoff * bump_cutoff;
+
+	evaluate_row(*this, bumps, x, y, z, count, resolve_isa(isa));
+}
+
+
+// Scattered points: sorted by cell of the bump index (counting sort), then each cell is evaluated like a row with its own bumps
+struct point_groups
+{
+	std::vector<int> order;			// points sorted by cell
+	std::vector<int> cell_start;	// points of the cell c are order[cell_start[c] .. cell_start[c+1]-1]
+	std::vector<float> x, y;		// sorted coordinates
+
+	point_groups(Terrain const& terrain, float const* px, float const* py, int count)
+	{
+		int const n_cells = terrain.bump_grid_resolution * terrain.bump_grid_resolution;
+		std::vector<int> cell(count);
+		cell_start.assign(n_cells + 1, 0);
+		for (int k = 0; k < count; k++)
+		{
+			cell[k] = terrain.bump_cell_of(px[k], py[k]);
+			cell_start[cell[k] + 1]++;
+		}
+		for (int c = 0; c < n_cells; c++)
+			cell_start[c + 1] += cell_start[c];
+
+		order.resize(count);
+		x.resize(count);
+		y.resize(count);
+		std::vector<int> fill(cell_start.begin(), cell_start.end() - 1);
+		for (int k = 0; k < count; k++)
+		{
+			int const j = fill[cell[k]]++;
+			order[j] = k;
+			x[j] = px[k];
+			y[j] = py[k];
+		}
+	}
+};
+
+static bump_set cell_bumps(Terrain const& terrain, int c)
+{
+	int const begin = terrain.bump_cell_start[c];
+
+	bump_set bumps;
+	bumps.x = terrain.bump_cell_x.data() + begin;
+	bumps.y = terrain.bump_cell_y.data() + begin;
+	bumps.h = terrain.bump_cell_h.data() + begin;
+	bumps.inv_s2 = terrain.bump_cell_inv_s2.data() + begin;
+	bumps.n = terrain.bump_cell_start[c + 1] - begin;
+	bumps.cutoff2 = terrain.bump_cutoff * terrain.bump_cutoff;
+	return bumps;
+}
+
+void Terrain::evaluate_terrain_height_points(float const* x, float const* y, float* z, int count) const
+{
+	if (count <= 0)
+		return;
+	if (bump_grid_resolution == 0)
+	{
+		evaluate_terrain_height_row(x, y, z, count);
+		return;
+	}
+
+	terrain_batch_isa const isa = resolve_isa(batch_auto);
+	point_groups groups(*this, x, y, count);
+	std::vector<float> sorted_z(count);
+
+	for (int c = 0; c + 1 < int(groups.cell_start.size()); c++)
+	{
+		int const begin = groups.cell_start[c], end = groups.cell_start[c + 1];
+		if (end > begin)
+			evaluate_row(*this, cell_bumps(*this, c), &groups.x[begin], &groups.y[begin], &sorted_z[begin], end - begin, isa);
+	}
+
+	for (int j = 0; j < count; j++)
+		z[groups.order[j]] = sorted_z[j];
+}
+
+void Terrain::evaluate_terrain_sample_points(float const* x, float const* y, float* z, float* dz_dx, float* dz_dy, int count) const
+{
+	if (count <= 0)
+		return;
+
+	terrain_batch_isa const isa = resolve_isa(batch_auto);
+
+	if (bump_grid_resolution == 0)
+	{
+		bump_set bumps;
+		bumps.x = bump_x.data();
+		bumps.y = bump_y.data();
+		bumps.h = bump_h.data();
+		bumps.inv_s2 = bump_inv_s2.data();
+		bumps.n = n_bumps;
+		bumps.cutoff2 = bump_cutoff * bump_cutoff;
+		evaluate_sample_row(*this, bumps, x, y, z, dz_dx, dz_dy, count, isa);
+		return;
+	}
+
+	point_groups groups(*this, x, y, count);
+	std::vector<float> sorted_z(count), sorted_dz_dx(count), sorted_dz_dy(count);
+
+	for (int c = 0; c + 1 < int(groups.cell_start.size()); c++)
+	{
+		int const begin = groups.cell_start[c], end = groups.cell_start[c + 1];
+		if (end > begin)
+			evaluate_sample_row(*this, cell_bumps(*this, c), &groups.x[begin], &groups.y[begin], &sorted_z[begin], &sorted_dz_dx[begin], &sorted_dz_dy[begin], end - begin, isa);
+	}
+
+	for (int j = 0; j < count; j++)
+	{
+		z[groups.order[j]] = sorted_z[j];
+		dz_dx[groups.order[j]] = sorted_dz_dx[j];
+		dz_dy[groups.order[j]] = sorted_dz_dy[j];
+	}
+}
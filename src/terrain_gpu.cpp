@@ -0,0 +1,169 @@
+#include "terrain_gpu.hpp"
+
+using namespace cgp;
+
+#ifndef __EMSCRIPTEN__
+
+// compile the vertex shader and link it with the transform feedback outputs
+static GLuint create_transform_feedback_program(std::string const& vertex_shader_path)
+{
+	std::string const source = read_text_file(vertex_shader_path);
+	char const* source_ptr = source.c_str();
+
+	GLuint shader = glCreateShader(GL_VERTEX_SHADER);
+	glShaderSource(shader, 1, &source_ptr, nullptr);
+	glCompileShader(shader);
+
+	GLint success = 0;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+	if (!success)
+	{
+		char log[1024];
+		glGetShaderInfoLog(shader, 1024, nullptr, log);
+		std::cerr << "Error: cannot compile " << vertex_shader_path << "\n" << log << std::endl;
+	}
+
+	GLuint program = glCreateProgram();
+	glAttachShader(program, shader);
+
+	char const* varyings[] = {"tf_position", "tf_normal"};
+	glTransformFeedbackVaryings(program, 2, varyings, GL_SEPARATE_ATTRIBS);
+	glLinkProgram(program);
+
+	glGetProgramiv(program, GL_LINK_STATUS, &success);
+	if (!success)
+	{
+		char log[1024];
+		glGetProgramInfoLog(program, 1024, nullptr, log);
+		std::cerr << "Error: cannot link " << vertex_shader_path << "\n" << log << std::endl;
+	}
+
+	glDetachShader(program, shader);
+	glDeleteShader(shader);
+
+	return program;
+}
+
+void terrain_gpu_generator::initialize(std::string const& shader_path)
+{
+	program = create_transform_feedback_program(shader_path);
+
+	glGenVertexArrays(1, &vao);
+
+	glGenBuffers(1, &bump_buffer);
+	glGenTextures(1, &bump_texture);
+}
+
+void terrain_gpu_generator::generate(Terrain const& terrain, mesh_drawable& drawable)
+{
+	int const N = terrain.N;
+
+	// upload the bumps (x, y, h, 1/s^2)
+	std::vector<float> bumps(4 * std::max(terrain.n_bumps, 1), 0.0f);
+	for (int i = 0; i < terrain.n_bumps; i++)
+	{
+		bumps[4 * i + 0] = terrain.bump_x[i];
+		bumps[4 * i + 1] = terrain.bump_y[i];
+		bumps[4 * i + 2] = terrain.bump_h[i];
+		bumps[4 * i + 3] = terrain.bump_inv_s2[i];
+	}
+
+	glBindBuffer(GL_TEXTURE_BUFFER, bump_buffer);
+	glBufferData(GL_TEXTURE_BUFFER, bumps.size() * sizeof(float), bumps.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_BUFFER, bump_texture);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, bump_buffer);
+
+	glUseProgram(program);
+	glUniform1i(glGetUniformLocation(program, "N"), N);
+	glUniform1f(glGetUniformLocation(program, "terrain_length"), terrain.terrain_length);
+	glUniform1i(glGetUniformLocation(program, "n_bumps"), terrain.n_bumps);
+	glUniform1f(glGetUniformLocation(program, "bump_cutoff2"), terrain.bump_cutoff * terrain.bump_cutoff);
+	glUniform1i(glGetUniformLocation(program, "bumps"), 0);
+
+	// one point per vertex, written in the position and normal VBOs
+	glEnable(GL_RASTERIZER_DISCARD);
+	glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, drawable.vbo["position"].id);
+	glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 1, drawable.vbo["normal"].id);
+
+	glBindVertexArray(vao);
+	glBeginTransformFeedback(GL_POINTS);
+	glDrawArrays(GL_POINTS, 0, N * N);
+	glEndTransformFeedback();
+	glBindVertexArray(0);
+
+	glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+	glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 1, 0);
+	glDisable(GL_RASTERIZER_DISCARD);
+
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	glUseProgram(0);
+}
+
+bool terrain_gpu_generator::readback_check(Terrain const& terrain, mesh_drawable& drawable, float* max_error) const
+{
+	int const N = terrain.N;
+	std::vector<vec3> positions(N * N);
+
+	glBindBuffer(GL_ARRAY_BUFFER, drawable.vbo["position"].id);
+	glGetBufferSubData(GL_ARRAY_BUFFER, 0, positions.size() * sizeof(vec3), positions.data());
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	// relative error (the walls keep the heights above 1)
+	float error = 0.0f;
+	for (vec3 const& p : positions)
+	{
+		float const z = terrain.evaluate_terrain_height(p.x, p.y);
+		error = std::max(error, std::abs(p.z - z) / std::abs(z));
+	}
+
+	if (max_error != nullptr)
+		*max_error = error;
+	return error <= readback_bound;
+}
+
+#endif
+
+mesh terrain_grid_mesh(int N, float terrain_length)
+{
+	mesh m;
+	m.position.resize(N * N);
+	m.normal.resize(N * N);
+
+	for (int ku = 0; ku < N; ++ku)
+	{
+		for (int kv = 0; kv < N; ++kv)
+		{
+			m.position[kv + N * ku] = {(ku / (N - 1.0f) - 0.5f) * terrain_length, (kv / (N - 1.0f) - 0.5f) * terrain_length, 0.0f};
+			m.normal[kv + N * ku] = {0, 0, 1};
+		}
+	}
+
+	m.connectivity.resize(2 * (N - 1) * (N - 1));
+	for (int ku = 0; ku < N - 1; ++ku)
+	{
+		for (int kv = 0; kv < N - 1; ++kv)
+		{
+			unsigned int idx = kv + N * ku;
+			int cell = kv + (N - 1) * ku;
+
+			m.connectivity[2 * cell] = {idx, idx + 1 + N, idx + 1};
+			m.connectivity[2 * cell + 1] = {idx, idx + N, idx + 1 + N};
+		}
+	}
+
+	m.fill_empty_field();
+	return m;
+}
+
+void update_vbo_range(mesh_drawable& drawable, std::string const& name, numarray<vec3> const& data, int first, int count)
+{
+	if (count <= 0)
+		return;
+
+	glBindBuffer(GL_ARRAY_BUFFER, drawable.vbo[name].id);
+	glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(vec3), count * sizeof(vec3), &data[first]);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "cgp/cgp.hpp"
+#include "terrain.hpp"
+
+/** GPU generation of the terrain vertices.
+The bumps are uploaded in a small buffer texture, and a vertex shader run with transform feedback (no rasterization)
+evaluates the heights and the analytic normals of the N*N grid directly into the position/normal VBOs of the terrain drawable.
+A new level then costs one draw call and a few kilobytes of transfer instead of a CPU rebuild and a full re-upload.
+Only OpenGL 3.3 features are used, so it works with every CGP_OPENGL_* version (but not with emscripten/WebGL).	*/
+struct terrain_gpu_generator
+{
+	GLuint program = 0;
+	GLuint vao = 0;				// empty VAO (required by the core profile, the shader has no vertex attribute)
+	GLuint bump_buffer = 0;		// bumps as (x, y, h, 1/s^2)
+	GLuint bump_texture = 0;	// buffer texture reading bump_buffer
+
+	void initialize(std::string const& shader_path);
+
+	// write the vertices of the terrain into drawable (which must have terrain.N * terrain.N vertices)
+	void generate(Terrain const& terrain, cgp::mesh_drawable& drawable);
+
+	// Read back the positions of drawable and compare them with evaluate_terrain_height (same bumps, same cutoff).
+	// Returns false if the maximal relative error |z_gpu - z_cpu| / |z_cpu| (written in max_error) is beyond readback_bound:
+	// GLSL only guarantees exp within 3 + 2|x| ulp, i.e. ~3e-6 at the cutoff, so 1e-4 leaves room for the sums of many bumps.
+	static constexpr float readback_bound = 1e-4f;
+	bool readback_check(Terrain const& terrain, cgp::mesh_drawable& drawable, float* max_error = nullptr) const;
+};
+
+// Grid mesh of N*N vertices with the connectivity of Terrain::update_positions, flat positions and vertical normals
+// (used to allocate the GPU buffers of a terrain generated by terrain_gpu_generator)
+cgp::mesh terrain_grid_mesh(int N, float terrain_length);
+
+// Overwrite the vertices [first, first+count) of the VBO "name" of the drawable with data[first .. first+count-1]
+void update_vbo_range(cgp::mesh_drawable& drawable, std::string const& name, cgp::numarray<cgp::vec3> const& data, int first, int count);
@@ -0,0 +1,288 @@
+#include "terrain_tiles.hpp"
+#include "parallel.hpp"
+
+using namespace cgp;
+
+// coordinate of the k-th sample of the finest grid along one axis
+static float tile_grid_coordinate(int k, int n_samples, float terrain_length)
+{
+	return (k / (n_samples - 1.0f) - 0.5f) * terrain_length;
+}
+
+void terrain_tiles_drawable::set_resolution(int n_samples)
+{
+	int const n_min = std::max(1, (n_samples - 1 + tile_samples - 1) / tile_samples);
+
+	n_tiles = 1;
+	n_lods = 1;
+	while (n_tiles < n_min)
+	{
+		n_tiles *= 2;
+		n_lods++;
+	}
+}
+
+mesh terrain_tiles_drawable::create_tile_mesh(Terrain const& terrain, terrain_tile_id const& id) const
+{
+	int const n_samples = n_tiles * tile_samples + 1;
+	int const step = 1 << id.lod;
+	int const M = tile_samples;				// number of cells along one side
+	int const V = M + 1;					// number of vertices along one side
+	int const ku0 = id.tu * M * step, kv0 = id.tv * M * step;
+
+	mesh m;
+	m.position.resize(V * V);
+	m.normal.resize(V * V);
+
+	// grid vertices: heights and normals of all the samples in one batched evaluation
+	std::vector<float> x(V * V), y(V * V), z(V * V), dz_dx(V * V), dz_dy(V * V);
+	for (int i = 0; i < V; i++)
+	{
+		for (int j = 0; j < V; j++)
+		{
+			x[j + V * i] = tile_grid_coordinate(ku0 + i * step, n_samples, terrain.terrain_length);
+			y[j + V * i] = tile_grid_coordinate(kv0 + j * step, n_samples, terrain.terrain_length);
+		}
+	}
+	terrain.evaluate_terrain_sample_points(x.data(), y.data(), z.data(), dz_dx.data(), dz_dy.data(), V * V);
+
+	for (int k = 0; k < V * V; k++)
+	{
+		m.position[k] = {x[k], y[k], z[k]};
+		m.normal[k] = normalize(vec3{-dz_dx[k], -dz_dy[k], 1.0f});
+	}
+
+	// same triangle organization as Terrain::update_positions
+	for (int i = 0; i < M; i++)
+	{
+		for (int j = 0; j < M; j++)
+		{
+			unsigned int idx = j + V * i;
+			m.connectivity.push_back({idx, idx + 1 + V, idx + 1});
+			m.connectivity.push_back({idx, idx + V, idx + 1 + V});
+		}
+	}
+
+	// skirts: each side is duplicated down to the lowest exact height along it (at the finest resolution), and connected to the original side.
+	// Along a side, the vertices of a neighbour tile of any level are finest samples, so its edge never goes below the skirt.
+	std::vector<float> side_x(M * step + 1), side_y(M * step + 1), side_z(M * step + 1);
+	for (int side = 0; side < 4; side++)
+	{
+		for (int k = 0; k <= M * step; k++)
+		{
+			int ku = ku0 + (side == 0 ? 0 : (side == 1 ? M * step : k));
+			int kv = kv0 + (side == 2 ? 0 : (side == 3 ? M * step : k));
+			side_x[k] = tile_grid_coordinate(ku, n_samples, terrain.terrain_length);
+			side_y[k] = tile_grid_coordinate(kv, n_samples, terrain.terrain_length);
+		}
+		terrain.evaluate_terrain_height_row(side_x.data(), side_y.data(), side_z.data(), M * step + 1);
+		float const bottom = *std::min_element(side_z.begin(), side_z.end()) - 0.1f;
+
+		unsigned int first = m.position.size();
+		for (int k = 0; k < V; k++)
+		{
+			int i = side == 0 ? 0 : (side == 1 ? M : k);
+			int j = side == 2 ? 0 : (side == 3 ? M : k);
+			int idx = j + V * i;
+
+			m.position.push_back({m.position[idx].x, m.position[idx].y, bottom});
+			m.normal.push_back(m.normal[idx]);
+		}
+		for (unsigned int k = 0; k < unsigned(M); k++)
+		{
+			unsigned int a = side == 0 ? k : (side == 1 ? k + V * M : (side == 2 ? V * k : M + V * k));
+			unsigned int b = side == 0 ? k + 1 : (side == 1 ? k + 1 + V * M : (side == 2 ? V * (k + 1) : M + V * (k + 1)));
+			m.connectivity.push_back({a, first + k, b});
+			m.connectivity.push_back({b, first + k, first + k + 1});
+		}
+	}
+
+	m.fill_empty_field();
+	return m;
+}
+
+void terrain_tiles_drawable::build_tiles(Terrain const& terrain, std::vector<terrain_tile_id> const& ids)
+{
+	std::vector<mesh> meshes(ids.size());
+	parallel_for_bands(int(ids.size()), n_threads, [&](int begin, int end)
+	{
+		for (int k = begin; k < end; k++)
+			meshes[k] = create_tile_mesh(terrain, ids[k]);
+	});
+
+	for (int k = 0; k < int(ids.size()); k++)
+	{
+		terrain_tile& t = tile(ids[k]);
+		mesh const& m = meshes[k];
+
+		t.aabb_min = m.position[0];
+		t.aabb_max = m.position[0];
+		for (vec3 const& p : m.position)
+		{
+			for (int c = 0; c < 3; c++)
+			{
+				t.aabb_min[c] = std::min(t.aabb_min[c], p[c]);
+				t.aabb_max[c] = std::max(t.aabb_max[c], p[c]);
+			}
+		}
+
+		t.drawable.clear();
+		t.drawable.initialize_data_on_gpu(m, shader);
+		t.drawable.material.color = {1, 1, 1};
+		t.resident = true;
+		t.last_used = frame;
+	}
+}
+
+void terrain_tiles_drawable::initialize_data_on_gpu(Terrain const& terrain, opengl_shader_structure const& shader_arg)
+{
+	clear();
+	shader = shader_arg;
+	frame = 0;
+
+	levels.resize(n_lods);
+	for (int lod = 0; lod < n_lods; lod++)
+		levels[lod].resize((n_tiles >> lod) * (n_tiles >> lod));
+
+	// the coarsest levels are always available, the others are built when the camera needs them
+	std::vector<terrain_tile_id> ids;
+	for (int lod = std::max(0, n_lods - n_persistent_levels); lod < n_lods; lod++)
+		for (int tu = 0; tu < (n_tiles >> lod); tu++)
+			for (int tv = 0; tv < (n_tiles >> lod); tv++)
+				ids.push_back({lod, tu, tv});
+	build_tiles(terrain, ids);
+}
+
+void terrain_tiles_drawable::update_area(Terrain const& terrain, float x_min, float x_max, float y_min, float y_max)
+{
+	// resident tiles overlapping the area, at every level (a tile of the level l covers terrain_length * 2^l / n_tiles along each coordinate)
+	std::vector<terrain_tile_id> ids;
+	for (int lod = 0; lod < n_lods; lod++)
+	{
+		int const n = n_tiles >> lod;
+		auto tile_index = [&](float x) { return std::max(0, std::min(n - 1, int(std::floor((x / terrain.terrain_length + 0.5f) * n)))); };
+
+		for (int tu = tile_index(x_min); tu <= tile_index(x_max); tu++)
+			for (int tv = tile_index(y_min); tv <= tile_index(y_max); tv++)
+				if (tile({lod, tu, tv}).resident)
+					ids.push_back({lod, tu, tv});
+	}
+	build_tiles(terrain, ids);
+}
+
+void terrain_tiles_drawable::clear()
+{
+	for (std::vector<terrain_tile>& level : levels)
+		for (terrain_tile& t : level)
+			t.drawable.clear();
+	levels.clear();
+}
+
+void terrain_tiles_drawable::draw(Terrain const& terrain, environment_structure const& environment, vec3 const& camera_position, float viewport_height)
+{
+	if (levels.empty())
+		return;
+	frame++;
+
+	// frustum planes (a,b,c,d), inside when a*x+b*y+c*z+d >= 0, from the rows of projection * view
+	mat4 const M = environment.camera_projection * environment.camera_view;
+	vec4 planes[6];
+	for (int k = 0; k < 3; k++)
+	{
+		for (int s = 0; s < 2; s++)
+		{
+			float sign = s == 0 ? 1.0f : -1.0f;
+			planes[2 * k + s] = {M(3, 0) + sign * M(k, 0), M(3, 1) + sign * M(k, 1), M(3, 2) + sign * M(k, 2), M(3, 3) + sign * M(k, 3)};
+		}
+	}
+
+	// pixels covered by a unit length seen at a unit distance, and spacing of the samples of the finest level
+	float const pixels_per_unit = 0.5f * viewport_height * std::abs(environment.camera_projection(1, 1));
+	float const finest_spacing = terrain.terrain_length / (n_tiles * tile_samples);
+
+	drawn_tiles = 0;
+	drawn_vertices = 0;
+	std::vector<terrain_tile_id> requests;
+
+	// traversal from the root (resident tiles only)
+	auto visit = [&](terrain_tile_id const& id, auto const& visit_ref) -> void
+	{
+		terrain_tile& t = tile(id);
+
+		// skip the tile if its box is entirely outside one of the planes (test the corner the furthest along the normal)
+		for (vec4 const& p : planes)
+		{
+			vec3 corner = {p.x >= 0 ? t.aabb_max.x : t.aabb_min.x, p.y >= 0 ? t.aabb_max.y : t.aabb_min.y, p.z >= 0 ? t.aabb_max.z : t.aabb_min.z};
+			if (p.x * corner.x + p.y * corner.y + p.z * corner.z + p.w < 0)
+				return;
+		}
+		t.last_used = frame;
+
+		// projected spacing of the samples at the closest point of the box
+		vec3 closest;
+		for (int c = 0; c < 3; c++)
+			closest[c] = std::max(t.aabb_min[c], std::min(camera_position[c], t.aabb_max[c]));
+		float const d = norm(closest - camera_position);
+		bool const refine = id.lod > 0 && finest_spacing * (1 << id.lod) * pixels_per_unit > max_sample_pixels * d;
+
+		if (refine)
+		{
+			terrain_tile_id const children[4] = {
+				{id.lod - 1, 2 * id.tu, 2 * id.tv}, {id.lod - 1, 2 * id.tu + 1, 2 * id.tv},
+				{id.lod - 1, 2 * id.tu, 2 * id.tv + 1}, {id.lod - 1, 2 * id.tu + 1, 2 * id.tv + 1}};
+
+			bool ready = true;
+			for (terrain_tile_id const& c : children)
+			{
+				if (!tile(c).resident)
+				{
+					requests.push_back(c);
+					ready = false;
+				}
+			}
+
+			if (ready)
+			{
+				// the children outside the frustum are kept as long as their parent is refined
+				for (terrain_tile_id const& c : children)
+					tile(c).last_used = frame;
+				for (terrain_tile_id const& c : children)
+					visit_ref(c, visit_ref);
+				return;
+			}
+		}
+
+		cgp::draw(t.drawable, environment);
+
+		int V = tile_samples + 1;
+		drawn_tiles++;
+		drawn_vertices += V * V + 4 * V;
+	};
+	visit({n_lods - 1, 0, 0}, visit);
+
+	// build the missing tiles, the coarsest first (the finer ones will be requested again by the next frames)
+	std::stable_sort(requests.begin(), requests.end(), [](terrain_tile_id const& a, terrain_tile_id const& b) { return a.lod > b.lod; });
+	if (int(requests.size()) > max_builds_per_frame)
+		requests.resize(max_builds_per_frame);
+	build_tiles(terrain, requests);
+	built_tiles = int(requests.size());
+
+	// release the tiles that were not needed for a while
+	resident_tiles = 0;
+	evicted_tiles = 0;
+	for (int lod = 0; lod < n_lods - n_persistent_levels; lod++)
+	{
+		for (terrain_tile& t : levels[lod])
+		{
+			if (t.resident && frame - t.last_used > evict_frames)
+			{
+				t.drawable.clear();
+				t.resident = false;
+				evicted_tiles++;
+			}
+		}
+	}
+	for (std::vector<terrain_tile> const& level : levels)
+		for (terrain_tile const& t : level)
+			resident_tiles += t.resident;
+}
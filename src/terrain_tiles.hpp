@@ -0,0 +1,76 @@
+#pragma once
+
+#include "cgp/cgp.hpp"
+#include "environment.hpp"
+#include "terrain.hpp"
+
+// A tile of the quadtree: at the level lod, the square covered by 2^lod x 2^lod tiles of the finest level, sampled every 2^lod samples
+struct terrain_tile
+{
+	cgp::vec3 aabb_min, aabb_max;				// bounding box of the mesh (skirts included), valid when resident
+	cgp::mesh_drawable drawable;
+	bool resident = false;						// the mesh is on the GPU
+	int last_used = -1;							// last frame in which the tile (or one of its descendants) was needed
+};
+
+// Position of a tile in the quadtree
+struct terrain_tile_id
+{
+	int lod, tu, tv;
+};
+
+/** Terrain drawn as a quadtree of tiles (chunked level of detail).
+The finest level has n_tiles*n_tiles tiles of tile_samples cells along one side, that is (n_tiles * tile_samples + 1)^2 samples.
+A tile of the level l covers 2^l x 2^l of them with the same number of vertices, up to the level n_lods-1, a single tile covering the
+terrain. set_resolution chooses n_tiles (a power of 2) from the number of samples, so the number of levels grows with log2(N).
+At draw time, the quadtree is traversed from the root: the tiles outside the view frustum are skipped, and a tile is replaced by its
+children while the spacing of its samples, at the closest point of its box, projects to more than max_sample_pixels on the screen.
+The drawn tiles and vertices then depend on the screen resolution rather than on N.
+Only the tiles reached by the traversal are built and uploaded, at most max_builds_per_frame per frame (computed in parallel):
+a tile is drawn until all its children are ready. The tiles that were not needed during evict_frames frames are released, except the
+n_persistent_levels coarsest levels, built at initialization.
+Neighbour tiles at different levels do not share all their edge vertices: each side of a tile has a vertical skirt reaching the lowest
+exact height along that side, which hides the cracks with any neighbour up to log2(tile_samples) levels apart (the levels selected
+for neighbour tiles differ by about one).
+The normals come from the analytic gradient, so the shading is continuous across the seams.	*/
+struct terrain_tiles_drawable
+{
+	int n_tiles = 8;				// number of tiles of the finest level along one coordinate (power of 2, see set_resolution)
+	int tile_samples = 64;			// number of cells along one side of a tile
+	int n_lods = 4;					// number of levels (n_tiles = 2^(n_lods-1))
+	float max_sample_pixels = 4.0f;	// a tile is refined while the spacing of its samples projects to more pixels than this
+	int max_builds_per_frame = 8;	// tiles built and uploaded during one draw call at most
+	int evict_frames = 300;			// frames after which an unused tile is released
+	int n_persistent_levels = 3;	// coarsest levels built at initialization and never released
+	int n_threads = 0;				// threads used to compute the tile meshes (0 = all the hardware threads)
+
+	std::vector<std::vector<terrain_tile>> levels;		// levels[l][tv + (n_tiles >> l) * tu]
+	cgp::opengl_shader_structure shader;
+
+	// statistics of the last draw call
+	int drawn_tiles = 0;
+	int drawn_vertices = 0;
+	int built_tiles = 0;
+	int evicted_tiles = 0;
+	int resident_tiles = 0;
+
+	// enough tiles to get at least n_samples samples along one coordinate
+	void set_resolution(int n_samples);
+
+	void initialize_data_on_gpu(Terrain const& terrain, cgp::opengl_shader_structure const& shader);
+	void draw(Terrain const& terrain, environment_structure const& environment, cgp::vec3 const& camera_position, float viewport_height);
+	void clear();		// release the GPU buffers of all the tiles
+
+	// rebuild the resident tiles overlapping the given area (after an edit of the terrain)
+	void update_area(Terrain const& terrain, float x_min, float x_max, float y_min, float y_max);
+
+	terrain_tile& tile(terrain_tile_id const& id) { return levels[id.lod][id.tv + (n_tiles >> id.lod) * id.tu]; }
+
+	// mesh of a tile, with its skirts
+	cgp::mesh create_tile_mesh(Terrain const& terrain, terrain_tile_id const& id) const;
+	// compute the meshes of the tiles (in parallel) and upload them to the GPU
+	void build_tiles(Terrain const& terrain, std::vector<terrain_tile_id> const& ids);
+
+private:
+	int frame = 0;
+};